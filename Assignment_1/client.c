@@ -7,8 +7,9 @@
 #include <netinet/in.h> // Internet address family structures and functions
 #include <arpa/inet.h>  // Functions for converting between host and network byte order
 #include <time.h>       // Time functions (if needed for timeouts, logging, etc.)
+#include <unistd.h>     // getopt() for command line options
 
-// Define the server's port number on which it listens for incoming UDP packets.
+// Define the server's default port number on which it listens for incoming UDP packets (can be changed with -p).
 #define PORT 8081
 
 // Define protocol primitives for the custom packet structure
@@ -39,6 +40,9 @@
 #define NO_END_PACKETID_SEQ_NO 9      // Sequence number to simulate missing end packet identifier error
 #define DUPLICATE_PACKET_SEQ_NO 10    // Sequence number to simulate a duplicate packet error
 
+// Number of data packets sent in one run of the client
+#define NUM_OF_PACKETS 10
+
 // Structure defining the layout of a Data Packet in this protocol
 typedef struct DataPacket {
     uint16_t start_packet_identifier; // Start identifier for the packet (fixed value)
@@ -69,6 +73,12 @@ typedef struct RejectPacket {
     uint16_t end_packet_identifier;   // End identifier for the packet
 } RejectPacket;
 
+// Forward error correction support (block encoding), used when the client is started with -k.
+#include "fec.h"
+
+// UDP segmentation offload, used for FEC blocks when the client is started with -g.
+#include "../Common/udp_offload.h"
+
 // Function: initializeDataPacket
 // Purpose: Sets up a DataPacket with the basic fixed fields (start and end identifiers, client ID, and packet type).
 DataPacket initializeDataPacket() {
@@ -114,88 +124,101 @@ void displayDataPacket(DataPacket dataPack) {
     printf("End Packet ID -  %x\n", dataPack.end_packet_identifier);
 }
 
-int main() {
-    // Declare variables for packet structures and network operations.
-    DataPacket dataPacket;      // Data packet to be sent
-    RejectPacket packetReceived; // Packet to store response from server (either ACK or REJECT)
-
-    struct sockaddr_in clAddress; // Structure to store server address information
-    int sockfd;                  // Socket file descriptor for network communication
-    socklen_t clAddrLen;         // Length of the address structure
-    FILE *payloadFile;           // File pointer to read payload data from a text file
+// Function: prepareDataPacket
+// Purpose: Fills the DataPacket with the next line of the payload file and the given sequence number,
+// then applies the simulated error assigned to that sequence number, if any (unless simulateErrors is 0).
+void prepareDataPacket(DataPacket *dataPacket, FILE *payloadFile, int seqNo, int simulateErrors) {
     char fpload[255];            // Buffer to temporarily store payload data read from file
-    int time_temp = 0;           // Temporary variable used to store the result of recvfrom() (used for timeout detection)
-    int seqNo = 0;               // Sequence number counter for packets
-    int resendCt = 0;            // Counter for the number of retransmission attempts
 
-    // SOCKET CREATION
-    // Create a UDP socket using IPv4 addressing. If socket creation fails, print an error message.
-    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) {
-        printf("\nERROR - A SOCKET COULDN'T BE CREATED.\n");
+    // Read a line from the payload file into fpload. If successful, copy it into the packet's payload.
+    if (fgets(fpload, sizeof(fpload), payloadFile) != NULL) {
+        strcpy(dataPacket->pload, fpload);
+    }
+    // Set the payload length based on the string length
+    dataPacket->plen = strlen(dataPacket->pload);
+    // Assign the current sequence number to the data packet
+    dataPacket->seg_no = seqNo;
+    dataPacket->end_packet_identifier = END_PACKET_IDENTIFIER;
+
+    // SIMULATING ERRORS BASED ON PREDEFINED SEQUENCE NUMBERS
+    // When a specific sequence number is reached, intentionally modify packet parameters to simulate errors.
+    if (!simulateErrors) {
+        return;
+    } else if (seqNo == OUT_OF_SEQUENCE_SEQ_NO) {
+        // Simulate an out-of-sequence packet by artificially increasing the segment number.
+        dataPacket->seg_no += 8;
+    } else if (seqNo == LENGTH_MISMATCH_SEQ_NO) {
+        // Simulate a length mismatch error by increasing the payload length without modifying the actual payload.
+        dataPacket->plen += 6;
+    } else if (seqNo == NO_END_PACKETID_SEQ_NO) {
+        // Simulate a missing end packet identifier error by setting it to zero.
+        dataPacket->end_packet_identifier = 0;
+    } else if (seqNo == DUPLICATE_PACKET_SEQ_NO) {
+        // Simulate a duplicate packet error by reusing a previous sequence number (packet 1).
+        dataPacket->seg_no = 1;
     }
+}
 
-    // Initialize the server address structure and zero out memory to avoid garbage values.
-    bzero(&clAddress, sizeof(clAddress));
-    clAddress.sin_family = AF_INET;                  // Set address family to IPv4
-    clAddress.sin_addr.s_addr = htonl(INADDR_ANY);     // Accept any incoming interface
-    clAddress.sin_port = htons(PORT);                // Set the server port (convert to network byte order)
-    clAddrLen = sizeof(clAddress);                   // Set the length of the address structure
-    
-    // SETTING A TIMEOUT FOR RECEIVE OPERATIONS
-    // Configure the socket to timeout after 3 seconds if no ACK is received from the server.
-    struct timeval setTimer;
-    setTimer.tv_sec = 3;                             // Timeout in seconds
-    setTimer.tv_usec = 0;                            // Additional microseconds (set to zero)
-    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &setTimer, sizeof(struct timeval));
+// Function: displayServerResponse
+// Purpose: Prints the ACK or REJECT packet the server sent back for the given packet.
+void displayServerResponse(RejectPacket packetReceived, int seqNo) {
+    // If an ACK is received, confirm successful transmission.
+    if (packetReceived.packet_type == ACK) {
+        printf("\nACK FOR PACKET# %d HAS BEEN SENT FROM SERVER\n", seqNo);
+    } 
+    // Handle various types of rejection based on the reject sub-code.
+    else if ((packetReceived.packet_type == REJECT) && (packetReceived.rej_sub_code == REJECT_OUT_OF_SEQUENCE)) {
+        printf("\nERROR - REJECT PACKET RECEIVED.\n");
+        printf("\nREJECT PACKET SUB-CODE - %x.\n", packetReceived.rej_sub_code);
+        printf("\nOUT OF SEQUENCE PACKET SENT.\n");
+    } else if ((packetReceived.packet_type == REJECT) && (packetReceived.rej_sub_code == REJECT_LENGTH_MISMATCH)) {
+        printf("\nERROR - REJECT PACKET RECEIVED.\n");
+        printf("\nREJECT PACKET SUB-CODE - %x.\n", packetReceived.rej_sub_code);
+        printf("\nLENGTH MIS-MATCH PACKET SENT.\n");
+    } else if ((packetReceived.packet_type == REJECT) && (packetReceived.rej_sub_code == REJECT_END_OF_PACKET_MISSING)) {
+        printf("\nERROR - REJECT PACKET RECEIVED.\n");
+        printf("\nREJECT PACKET SUB-CODE - %x.\n", packetReceived.rej_sub_code);
+        printf("\nEND OF PACKET ID MISSING.\n");
+    } else if ((packetReceived.packet_type == REJECT) && (packetReceived.rej_sub_code == REJECT_DUPLICATE_PACKET)) {
+        printf("\nERROR - REJECT PACKET RECEIVED.\n");
+        printf("\nREJECT PACKET SUB-CODE - %x.\n", packetReceived.rej_sub_code);
+        printf("\nDUPLICATE PACKET SENT.\n");
+    }
+}
+
+// Function: responseSegmentNo
+// Purpose: Returns the segment number the server reported in an ACK or REJECT packet.
+// The field sits at a different offset in the two packet layouts.
+int responseSegmentNo(RejectPacket packetReceived) {
+    if (packetReceived.packet_type == ACK) {
+        AckPacket ackPacket;
+        memcpy(&ackPacket, &packetReceived, sizeof(AckPacket));
+        return ackPacket.received_segment_no;
+    }
+    return packetReceived.received_segment_no;
+}
+
+// Function: sendPlainPackets
+// Purpose: Sends the packets one at a time, waiting for an ACK or REJECT before moving to the next one.
+void sendPlainPackets(int sockfd, struct sockaddr_in *clAddress, socklen_t clAddrLen, FILE *payloadFile, int simulateErrors) {
+    DataPacket dataPacket;       // Data packet to be sent
+    RejectPacket packetReceived; // Packet to store response from server (either ACK or REJECT)
+    int time_temp = 0;           // Temporary variable used to store the result of recvfrom() (used for timeout detection)
+    int seqNo = 0;               // Sequence number counter for packets
+    int resendCt = 0;            // Counter for the number of retransmission attempts
 
     // Initialize the DataPacket with default header values.
     dataPacket = initializeDataPacket();
 
-    // OPEN THE PAYLOAD FILE
-    // Open the file "payload.txt" in read-text mode. This file contains the data to be sent in each packet.
-    payloadFile = fopen("payload.txt", "rt");
-    if (payloadFile == NULL) {
-        printf("\nERROR - FILE NOT FOUND\n");
-    }
-
     // LOOP TO SEND 10 PACKETS
     // Iterate 10 times to send 10 different packets with incrementing sequence numbers.
-    for (int i = 0; i < 10; i++) {
+    for (int i = 0; i < NUM_OF_PACKETS; i++) {
         seqNo++;           // Increment the sequence number for the current packet
         resendCt = 0;      // Reset retransmission counter for this packet
         time_temp = 0;     // Reset the timeout indicator
 
-        // Read a line from the payload file into fpload. If successful, copy it into the packet's payload.
-        if (fgets(fpload, sizeof(fpload), payloadFile) != NULL) {
-            strcpy(dataPacket.pload, fpload);
-        }
-        // Set the payload length based on the string length
-        dataPacket.plen = strlen(dataPacket.pload);
-        // Assign the current sequence number to the data packet
-        dataPacket.seg_no = seqNo;
-
-        // SIMULATING ERRORS BASED ON PREDEFINED SEQUENCE NUMBERS
-        // When a specific sequence number is reached, intentionally modify packet parameters to simulate errors.
-        if (seqNo == OUT_OF_SEQUENCE_SEQ_NO) {
-            // Simulate an out-of-sequence packet by artificially increasing the segment number.
-            dataPacket.seg_no += 8;
-        } else if (seqNo == LENGTH_MISMATCH_SEQ_NO) {
-            // Simulate a length mismatch error by increasing the payload length without modifying the actual payload.
-            dataPacket.plen += 6;
-        } else if (seqNo == NO_END_PACKETID_SEQ_NO) {
-            // Simulate a missing end packet identifier error by setting it to zero.
-            dataPacket.end_packet_identifier = 0;
-        } else if (seqNo == DUPLICATE_PACKET_SEQ_NO) {
-            // Simulate a duplicate packet error by reusing a previous sequence number (packet 1).
-            dataPacket.seg_no = 1;
-        }
-
-        // Ensure that if the error for missing end packet identifier is not simulated, 
-        // then the end_packet_identifier is reset to its defined constant.
-        if (seqNo != NO_END_PACKETID_SEQ_NO) {
-            dataPacket.end_packet_identifier = END_PACKET_IDENTIFIER;
-        }
+        // Load the payload and apply any simulated error for this sequence number.
+        prepareDataPacket(&dataPacket, payloadFile, seqNo, simulateErrors);
 
         // SEND THE PACKET AND WAIT FOR ACK/REJECT RESPONSE
         // Attempt to send the packet and wait for a response, with retransmissions if necessary.
@@ -206,7 +229,7 @@ int main() {
             displayDataPacket(dataPacket);
 
             // Send the data packet to the server using UDP sendto()
-            sendto(sockfd, &dataPacket, sizeof(DataPacket), 0, (struct sockaddr *)&clAddress, clAddrLen);
+            sendto(sockfd, &dataPacket, sizeof(DataPacket), 0, (struct sockaddr *)clAddress, clAddrLen);
 
             // Attempt to receive a response from the server.
             // The response could be either an ACK or a REJECT packet.
@@ -220,28 +243,8 @@ int main() {
                 printf("\nERROR - NO ACK RECEIVED FROM SERVER.\n");
                 printf("RE-TRANSMITTING THE PACKET.\n");
                 resendCt++;  // Increment the retransmission counter
-            } 
-            // If an ACK is received, confirm successful transmission.
-            else if (packetReceived.packet_type == ACK) {
-                printf("\nACK FOR PACKET# %d HAS BEEN SENT FROM SERVER\n", seqNo);
-            } 
-            // Handle various types of rejection based on the reject sub-code.
-            else if ((packetReceived.packet_type == REJECT) && (packetReceived.rej_sub_code == REJECT_OUT_OF_SEQUENCE)) {
-                printf("\nERROR - REJECT PACKET RECEIVED.\n");
-                printf("\nREJECT PACKET SUB-CODE - %x.\n", packetReceived.rej_sub_code);
-                printf("\nOUT OF SEQUENCE PACKET SENT.\n");
-            } else if ((packetReceived.packet_type == REJECT) && (packetReceived.rej_sub_code == REJECT_LENGTH_MISMATCH)) {
-                printf("\nERROR - REJECT PACKET RECEIVED.\n");
-                printf("\nREJECT PACKET SUB-CODE - %x.\n", packetReceived.rej_sub_code);
-                printf("\nLENGTH MIS-MATCH PACKET SENT.\n");
-            } else if ((packetReceived.packet_type == REJECT) && (packetReceived.rej_sub_code == REJECT_END_OF_PACKET_MISSING)) {
-                printf("\nERROR - REJECT PACKET RECEIVED.\n");
-                printf("\nREJECT PACKET SUB-CODE - %x.\n", packetReceived.rej_sub_code);
-                printf("\nEND OF PACKET ID MISSING.\n");
-            } else if ((packetReceived.packet_type == REJECT) && (packetReceived.rej_sub_code == REJECT_DUPLICATE_PACKET)) {
-                printf("\nERROR - REJECT PACKET RECEIVED.\n");
-                printf("\nREJECT PACKET SUB-CODE - %x.\n", packetReceived.rej_sub_code);
-                printf("\nDUPLICATE PACKET SENT.\n");
+            } else {
+                displayServerResponse(packetReceived, seqNo);
             }
 
             // If the maximum number of retransmission attempts has been reached, exit the program with an error.
@@ -255,6 +258,185 @@ int main() {
         // Print a separator for the completion of the current packet's transmission process.
         printf("\n\n");
     }
+}
+
+// Function: sendFecSegments
+// Purpose: Sends count FEC packets stored back to back. With GSO they leave as one super-buffer that the
+// kernel splits into datagrams; if GSO is off or the kernel refuses it, each packet is sent on its own
+// and GSO stays off for the rest of the run.
+void sendFecSegments(int sockfd, struct sockaddr_in *clAddress, socklen_t clAddrLen, FecPacket packets[], int count, int *useGso) {
+    if (*useGso) {
+        if (udpGsoSend(sockfd, packets, sizeof(FecPacket), count, (struct sockaddr *)clAddress, clAddrLen) >= 0) {
+            return;
+        }
+        printf("\nINFO - UDP GSO IS NOT AVAILABLE, SENDING PACKETS ONE BY ONE.\n");
+        *useGso = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        sendto(sockfd, &packets[i], sizeof(FecPacket), 0, (struct sockaddr *)clAddress, clAddrLen);
+    }
+}
+
+// Function: sendFecPackets
+// Purpose: Sends the packets in blocks of fecK data packets followed by fecM repair packets.
+// The server answers a block only once it has every data packet, rebuilding lost ones from the
+// repair packets. If the answers do not arrive within the ACK timeout, the data packets that
+// have not been answered yet are retransmitted.
+void sendFecPackets(int sockfd, struct sockaddr_in *clAddress, socklen_t clAddrLen, FILE *payloadFile, int simulateErrors, int fecK, int fecM, int useGso) {
+    DataPacket dataPackets[NUM_OF_PACKETS];         // All data packets of this run, prepared up front
+    FecPacket blockPackets[FEC_MAX_K + FEC_MAX_M];  // Data then repair packets of the current block, back to back
+    FecPacket resendPackets[FEC_MAX_K];             // Unanswered data packets gathered for a retransmission
+    DataPacket repair[FEC_MAX_M];                   // Parity computed over the current block
+    RejectPacket packetReceived;                    // Packet to store response from server (either ACK or REJECT)
+    DataPacket dataPacket = initializeDataPacket();
+    uint16_t session = (uint16_t)(getpid() ^ time(NULL)); // Tells the server this run apart from earlier ones from the same port
+
+    for (int i = 0; i < NUM_OF_PACKETS; i++) {
+        prepareDataPacket(&dataPacket, payloadFile, i + 1, simulateErrors);
+        dataPackets[i] = dataPacket;
+    }
+
+    int blockNo = 0;
+    for (int first = 0; first < NUM_OF_PACKETS; first += fecK, blockNo++) {
+        int k = (NUM_OF_PACKETS - first < fecK) ? NUM_OF_PACKETS - first : fecK;
+        int m = (fecM < k) ? fecM : k;
+        int answered[FEC_MAX_K] = {0};
+        int answeredCt = 0;
+        int resendCt = 0;
+
+        // Wrap each data packet and compute the repair packets for the block.
+        fecEncodeBlock(&dataPackets[first], k, m, repair);
+        for (int i = 0; i < k + m; i++) {
+            FecPacket *fecPacket = &blockPackets[i];
+            fecPacket->start_packet_identifier = START_PACKET_IDENTIFIER;
+            fecPacket->client_id = CLIENT_ID;
+            fecPacket->packet_type = (i < k) ? FEC_DATA : FEC_REPAIR;
+            fecPacket->block_no = blockNo;
+            fecPacket->session = session;
+            fecPacket->index = (i < k) ? i : i - k;
+            fecPacket->k = k;
+            fecPacket->m = m;
+            fecPacket->body = (i < k) ? dataPackets[first + i] : repair[i - k];
+            fecPacket->end_packet_identifier = END_PACKET_IDENTIFIER;
+        }
+
+        // Send the whole block without waiting for ACKs in between.
+        printf("\n\nBlock #%d sent: %d data packet(s) and %d repair packet(s).\n", blockNo, k, m);
+        for (int i = 0; i < k; i++) {
+            displayDataPacket(dataPackets[first + i]);
+        }
+        sendFecSegments(sockfd, clAddress, clAddrLen, blockPackets, k + m, &useGso);
+
+        // Collect one response per data packet, matching them by segment number.
+        while (answeredCt < k) {
+            int time_temp = recvfrom(sockfd, &packetReceived, sizeof(RejectPacket), 0, NULL, NULL);
+
+            if (time_temp <= 0) {
+                resendCt++;
+                if (resendCt >= MAX_TRIES) {
+                    printf("\nERROR - SERVER NOT RESPONDING.\n");
+                    exit(0);
+                }
+                printf("\nERROR - NO ACK RECEIVED FROM SERVER.\n");
+                printf("RE-TRANSMITTING %d PACKET(S) OF BLOCK #%d.\n", k - answeredCt, blockNo);
+                int resendCount = 0;
+                for (int i = 0; i < k; i++) {
+                    if (!answered[i]) {
+                        resendPackets[resendCount++] = blockPackets[i];
+                    }
+                }
+                sendFecSegments(sockfd, clAddress, clAddrLen, resendPackets, resendCount, &useGso);
+                continue;
+            }
+
+            int segNo = responseSegmentNo(packetReceived);
+            for (int i = 0; i < k; i++) {
+                if (!answered[i] && dataPackets[first + i].seg_no == segNo) {
+                    answered[i] = 1;
+                    answeredCt++;
+                    printf("\n\nServer Response.\n");
+                    displayServerResponse(packetReceived, first + i + 1);
+                    break;
+                }
+            }
+        }
+        printf("\n\n");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_in clAddress; // Structure to store server address information
+    int sockfd;                  // Socket file descriptor for network communication
+    socklen_t clAddrLen;         // Length of the address structure
+    FILE *payloadFile;           // File pointer to read payload data from a text file
+    int fecK = 0;                // Data packets per FEC block (0 disables FEC)
+    int fecM = 0;                // Repair packets per FEC block
+    int port = PORT;             // Server port to send to
+    int simulateErrors = 1;      // Whether to inject the errors at the predefined sequence numbers
+    int useGso = 0;              // Whether FEC blocks are sent as one GSO super-buffer
+    int option;
+
+    // COMMAND LINE OPTIONS
+    // -k K -m M enables forward error correction with K data and M repair packets per block.
+    // -p PORT sends to a different port, e.g. the impairment proxy in ../Tools.
+    // -c sends clean packets, leaving errors to the network (or the impairment proxy).
+    // -g sends each FEC block with UDP GSO (Linux), falling back to one sendto() per packet.
+    while ((option = getopt(argc, argv, "k:m:p:cg")) != -1) {
+        if (option == 'k') {
+            fecK = atoi(optarg);
+        } else if (option == 'm') {
+            fecM = atoi(optarg);
+        } else if (option == 'p') {
+            port = atoi(optarg);
+        } else if (option == 'c') {
+            simulateErrors = 0;
+        } else if (option == 'g') {
+            useGso = 1;
+        } else {
+            printf("Usage: %s [-k data_packets_per_block -m repair_packets_per_block [-g]] [-p port] [-c]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (fecK != 0 && !fecValidGeometry(fecK, fecM)) {
+        printf("\nERROR - FEC NEEDS 1 <= K <= %d AND 0 <= M <= MIN(K, %d).\n", FEC_MAX_K, FEC_MAX_M);
+        exit(1);
+    }
+
+    // SOCKET CREATION
+    // Create a UDP socket using IPv4 addressing. If socket creation fails, print an error message.
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        printf("\nERROR - A SOCKET COULDN'T BE CREATED.\n");
+    }
+
+    // Initialize the server address structure and zero out memory to avoid garbage values.
+    bzero(&clAddress, sizeof(clAddress));
+    clAddress.sin_family = AF_INET;                  // Set address family to IPv4
+    clAddress.sin_addr.s_addr = htonl(INADDR_ANY);     // Accept any incoming interface
+    clAddress.sin_port = htons(port);                // Set the server port (convert to network byte order)
+    clAddrLen = sizeof(clAddress);                   // Set the length of the address structure
+    
+    // SETTING A TIMEOUT FOR RECEIVE OPERATIONS
+    // Configure the socket to timeout after 3 seconds if no ACK is received from the server.
+    struct timeval setTimer;
+    setTimer.tv_sec = 3;                             // Timeout in seconds
+    setTimer.tv_usec = 0;                            // Additional microseconds (set to zero)
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &setTimer, sizeof(struct timeval));
+
+    // OPEN THE PAYLOAD FILE
+    // Open the file "payload.txt" in read-text mode. This file contains the data to be sent in each packet.
+    payloadFile = fopen("payload.txt", "rt");
+    if (payloadFile == NULL) {
+        printf("\nERROR - FILE NOT FOUND\n");
+    }
+
+    // SEND THE PACKETS
+    // Either one at a time with stop-and-wait retransmission, or in FEC blocks.
+    if (fecK > 0) {
+        sendFecPackets(sockfd, &clAddress, clAddrLen, payloadFile, simulateErrors, fecK, fecM, useGso);
+    } else {
+        sendPlainPackets(sockfd, &clAddress, clAddrLen, payloadFile, simulateErrors);
+    }
 
     // Close the file pointer once all packets have been processed.
     fclose(payloadFile);
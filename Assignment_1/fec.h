@@ -0,0 +1,147 @@
+// -----------------------------------------------------------------------------
+// Forward Error Correction (FEC) for the Data Packet Protocol
+// -----------------------------------------------------------------------------
+//
+// The client groups K data packets into a block and follows them with M repair
+// packets. Repair packet g is the XOR of every data packet whose index i in the
+// block satisfies (i % M == g), so the server can rebuild one lost data packet
+// per repair group without waiting for a retransmission. If more packets are
+// lost than the repair packets can cover, the client falls back to resending
+// the missing data packets after the usual ACK timeout.
+//
+// This file must be included after the DataPacket structure has been defined.
+
+#ifndef FEC_H
+#define FEC_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Packet types used when FEC mode is enabled.
+#define FEC_DATA 0XFFF8                 // Wraps one data packet of a block.
+#define FEC_REPAIR 0XFFF9               // Carries the XOR parity of one repair group.
+
+// Upper limits on the block geometry so the server can use fixed-size buffers.
+#define FEC_MAX_K 16                    // Maximum number of data packets per block.
+#define FEC_MAX_M 4                     // Maximum number of repair packets per block.
+
+// Structure for a packet sent while FEC mode is enabled.
+// The first fields line up with DataPacket so the server can read packet_type before knowing which one it received.
+typedef struct FecPacket {
+    uint16_t start_packet_identifier;   // Marker for the start of the packet.
+    uint8_t client_id;                  // Identifier for the client sending this packet.
+    uint16_t packet_type;               // FEC_DATA or FEC_REPAIR.
+    uint16_t block_no;                  // Block this packet belongs to, counted from 0.
+    uint16_t session;                   // Random id of the client run, so a new run is not taken for a retransmission.
+    uint8_t index;                      // Data index within the block, or repair group number.
+    uint8_t k;                          // Number of data packets in this block.
+    uint8_t m;                          // Number of repair packets in this block.
+    DataPacket body;                    // The data packet itself, or the parity of a repair group.
+    uint16_t end_packet_identifier;     // Marker for the end of the packet.
+} FecPacket;
+
+// Receive-side state for the block currently being reassembled.
+typedef struct FecBlock {
+    int block_no;                       // Block number, or -1 if no block is in progress.
+    uint8_t k;                          // Number of data packets in the block.
+    uint8_t m;                          // Number of repair packets in the block.
+    uint32_t have_data;                 // Bit i is set once data packet i is present.
+    uint32_t have_repair;               // Bit g is set once repair packet g is present.
+    DataPacket data[FEC_MAX_K];         // Data packets received or rebuilt so far.
+    DataPacket repair[FEC_MAX_M];       // Repair packets received so far.
+} FecBlock;
+
+// XOR one packet-sized symbol into another.
+// The loop is kept over plain bytes so the compiler can vectorise it.
+static inline void fecXor(DataPacket *dst, const DataPacket *src) {
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned char *s = (const unsigned char *)src;
+    for (size_t i = 0; i < sizeof(DataPacket); i++) {
+        d[i] ^= s[i];
+    }
+}
+
+// Check that a block geometry received from the network is usable.
+static inline int fecValidGeometry(int k, int m) {
+    return (k >= 1) && (k <= FEC_MAX_K) && (m >= 0) && (m <= FEC_MAX_M) && (m <= k);
+}
+
+// Build the M repair packets for a block of K data packets.
+static inline void fecEncodeBlock(const DataPacket data[], int k, int m, DataPacket repair[]) {
+    for (int g = 0; g < m; g++) {
+        memset(&repair[g], 0, sizeof(DataPacket));
+    }
+    for (int i = 0; i < k && m > 0; i++) {
+        fecXor(&repair[i % m], &data[i]);
+    }
+}
+
+// Start reassembling a new block.
+static inline void fecResetBlock(FecBlock *block, int block_no, int k, int m) {
+    block->block_no = block_no;
+    block->k = k;
+    block->m = m;
+    block->have_data = 0;
+    block->have_repair = 0;
+}
+
+// Store a received FEC packet in the block.
+// Returns 1 if the packet was stored, 0 if it was a duplicate or did not fit the block.
+static inline int fecAddPacket(FecBlock *block, const FecPacket *packet) {
+    if (packet->packet_type == FEC_DATA && packet->index < block->k) {
+        if (block->have_data & (1u << packet->index)) {
+            return 0;
+        }
+        block->data[packet->index] = packet->body;
+        block->have_data |= 1u << packet->index;
+        return 1;
+    }
+    if (packet->packet_type == FEC_REPAIR && packet->index < block->m) {
+        if (block->have_repair & (1u << packet->index)) {
+            return 0;
+        }
+        block->repair[packet->index] = packet->body;
+        block->have_repair |= 1u << packet->index;
+        return 1;
+    }
+    return 0;
+}
+
+// Rebuild missing data packets from the repair packets.
+// A repair group can restore its data packet only when exactly one member is missing.
+// Returns the number of data packets that were rebuilt.
+static inline int fecRecover(FecBlock *block) {
+    int rebuilt = 0;
+    for (int g = 0; g < block->m; g++) {
+        if (!(block->have_repair & (1u << g))) {
+            continue;
+        }
+        int missing = -1;
+        int missingCount = 0;
+        for (int i = g; i < block->k; i += block->m) {
+            if (!(block->have_data & (1u << i))) {
+                missing = i;
+                missingCount++;
+            }
+        }
+        if (missingCount != 1) {
+            continue;
+        }
+        block->data[missing] = block->repair[g];
+        for (int i = g; i < block->k; i += block->m) {
+            if (i != missing) {
+                fecXor(&block->data[missing], &block->data[i]);
+            }
+        }
+        block->have_data |= 1u << missing;
+        rebuilt++;
+    }
+    return rebuilt;
+}
+
+// A block is complete once every data packet has been received or rebuilt.
+static inline int fecBlockComplete(const FecBlock *block) {
+    return block->block_no >= 0 && block->have_data == ((1u << block->k) - 1);
+}
+
+#endif
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// -----------------------------------------------------------------------------
+// FEC Benchmark
+// -----------------------------------------------------------------------------
+//
+// Simulates sending packets over a lossy link and compares the plain stop-and-wait
+// protocol against FEC blocks of K data and M repair packets. The FEC side runs the
+// real encode/rebuild code from fec.h on random payloads and checks every rebuilt
+// packet against the original. Time is modelled: a delivered round costs one RTT
+// and every missed response costs a full ACK timeout, as in client.c.
+//
+// Compile: gcc -O2 fec_bench.c -o fec_bench
+// Run:     ./fec_bench [-k K] [-m M] [-n packets] [-r rtt_us] [-s seed]
+
+// Timing and retransmission constants, matching client.c.
+#define ACK_TIMER_SET 3               // Seconds to wait for an ACK before retransmitting.
+#define MAX_TRIES 3                   // Maximum number of tries before giving up.
+
+// Same layout as the DataPacket in client.c and server.c.
+typedef struct DataPacket{
+    uint16_t start_packet_identifier;
+    uint8_t client_id;
+    uint16_t packet_type;
+    uint8_t seg_no;
+    uint8_t plen;
+    char pload[255];
+    uint16_t end_packet_identifier;
+} DataPacket;
+
+#include "fec.h"
+
+// Loss rates the benchmark sweeps over, in percent.
+static const double lossRates[] = {0.0, 0.5, 1.0, 2.0, 5.0, 10.0, 20.0};
+
+// Results of one simulated run.
+typedef struct BenchResult{
+    double *latency;                  // Per-packet latency in microseconds.
+    long packets;                     // Packets that were answered.
+    long failed;                      // Packets given up on after MAX_TRIES.
+    long datagrams;                   // Datagrams the client sent, including repairs and retransmissions.
+    double elapsed;                   // Total simulated time in microseconds.
+} BenchResult;
+
+// Seeded xorshift generator so every run is reproducible.
+static uint64_t rngState;
+
+static double nextRandom(void){
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return (rngState >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int delivered(double loss){
+    return nextRandom() >= loss;
+}
+
+static int compareDouble(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double *sorted, long count, double p){
+    if(count == 0){
+        return 0;
+    }
+    long index = (long)(p * (count - 1));
+    return sorted[index];
+}
+
+// Stop-and-wait: one packet in flight, retransmitted after every ACK timeout.
+static void runPlain(BenchResult *result, long packets, double loss, double rtt){
+    double timeout = ACK_TIMER_SET * 1e6;
+    for(long i = 0; i < packets; i++){
+        double t = 0;
+        int tries = 0;
+        while(tries < MAX_TRIES){
+            result->datagrams++;
+            if(delivered(loss) && delivered(loss)){
+                break;
+            }
+            t += timeout;
+            tries++;
+        }
+        if(tries >= MAX_TRIES){
+            result->failed++;
+            result->elapsed += t;
+            continue;
+        }
+        result->latency[result->packets++] = t + rtt;
+        result->elapsed += t + rtt;
+    }
+}
+
+// FEC blocks: K data and M repair packets per block, unanswered data resent after a timeout.
+static int runFec(BenchResult *result, long packets, double loss, double rtt, int fecK, int fecM){
+    double timeout = ACK_TIMER_SET * 1e6;
+    DataPacket data[FEC_MAX_K];
+    DataPacket repair[FEC_MAX_M];
+    FecPacket fecPacket;
+    FecBlock block;
+
+    for(long first = 0; first < packets; first += fecK){
+        int k = (packets - first < fecK) ? (int)(packets - first) : fecK;
+        int m = (fecM < k) ? fecM : k;
+        int answered[FEC_MAX_K] = {0};
+        int answeredCt = 0;
+        double t = 0;
+
+        for(int i = 0; i < k; i++){
+            unsigned char *bytes = (unsigned char *)&data[i];
+            for(size_t b = 0; b < sizeof(DataPacket); b++){
+                bytes[b] = (unsigned char)(nextRandom() * 256);
+            }
+        }
+        fecEncodeBlock(data, k, m, repair);
+        fecResetBlock(&block, 0, k, m);
+        fecPacket.block_no = 0;
+
+        for(int tries = 0; tries < MAX_TRIES && answeredCt < k; tries++){
+            // First round sends data and repair, later rounds resend unanswered data only.
+            for(int i = 0; i < k + (tries == 0 ? m : 0); i++){
+                if(i < k && answered[i]){
+                    continue;
+                }
+                result->datagrams++;
+                if(!delivered(loss)){
+                    continue;
+                }
+                fecPacket.packet_type = (i < k) ? FEC_DATA : FEC_REPAIR;
+                fecPacket.index = (i < k) ? i : i - k;
+                fecPacket.body = (i < k) ? data[i] : repair[i - k];
+                fecAddPacket(&block, &fecPacket);
+            }
+            fecRecover(&block);
+
+            // The server only answers once the whole block is present.
+            if(fecBlockComplete(&block)){
+                for(int i = 0; i < k; i++){
+                    if(memcmp(&block.data[i], &data[i], sizeof(DataPacket)) != 0){
+                        printf("\nERROR - REBUILT PACKET %d DOES NOT MATCH THE ORIGINAL.\n", i);
+                        return -1;
+                    }
+                    if(!answered[i] && delivered(loss)){
+                        answered[i] = 1;
+                        answeredCt++;
+                        result->latency[result->packets++] = t + rtt;
+                    }
+                }
+            }
+            if(answeredCt < k){
+                t += timeout;
+            }
+        }
+        result->failed += k - answeredCt;
+        result->elapsed += (answeredCt < k) ? t : t + rtt;
+    }
+    return 0;
+}
+
+static void printResult(const char *mode, double loss, BenchResult *result, long packets){
+    qsort(result->latency, result->packets, sizeof(double), compareDouble);
+    double goodput = result->elapsed > 0 ? result->packets * 255.0 / (result->elapsed / 1e6) / 1024.0 : 0;
+    printf("%6.1f%%  %-10s %10.3f %10.3f %10.3f %12.1f %10.3f %8ld\n",
+           loss * 100, mode,
+           percentile(result->latency, result->packets, 0.50) / 1000.0,
+           percentile(result->latency, result->packets, 0.99) / 1000.0,
+           percentile(result->latency, result->packets, 0.999) / 1000.0,
+           goodput, (double)result->datagrams / packets, result->failed);
+}
+
+int main(int argc, char *argv[]){
+    int fecK = 8;
+    int fecM = 2;
+    long packets = 100000;
+    double rtt = 1000;
+    uint64_t seed = 1;
+    int option;
+
+    while((option = getopt(argc, argv, "k:m:n:r:s:")) != -1){
+        if(option == 'k'){
+            fecK = atoi(optarg);
+        }else if(option == 'm'){
+            fecM = atoi(optarg);
+        }else if(option == 'n'){
+            packets = atol(optarg);
+        }else if(option == 'r'){
+            rtt = atof(optarg);
+        }else if(option == 's'){
+            seed = strtoull(optarg, NULL, 10);
+        }else{
+            printf("Usage: %s [-k K] [-m M] [-n packets] [-r rtt_us] [-s seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(!fecValidGeometry(fecK, fecM) || packets <= 0){
+        printf("\nERROR - FEC NEEDS 1 <= K <= %d AND 0 <= M <= MIN(K, %d).\n", FEC_MAX_K, FEC_MAX_M);
+        return 1;
+    }
+
+    double *latency = malloc(packets * sizeof(double));
+    char fecName[32];
+    snprintf(fecName, sizeof(fecName), "fec(%d,%d)", fecK, fecM);
+
+    printf("packets=%ld rtt=%.0fus ack_timeout=%ds max_tries=%d seed=%llu\n\n",
+           packets, rtt, ACK_TIMER_SET, MAX_TRIES, (unsigned long long)seed);
+    printf("%7s  %-10s %10s %10s %10s %12s %10s %8s\n",
+           "loss", "mode", "p50 ms", "p99 ms", "p99.9 ms", "goodput KB/s", "sent/pkt", "failed");
+
+    for(size_t i = 0; i < sizeof(lossRates) / sizeof(lossRates[0]); i++){
+        double loss = lossRates[i] / 100.0;
+
+        rngState = seed * 0x9E3779B97F4A7C15ULL + i + 1;
+        BenchResult plain = {latency, 0, 0, 0, 0};
+        runPlain(&plain, packets, loss, rtt);
+        printResult("plain", loss, &plain, packets);
+
+        rngState = seed * 0x9E3779B97F4A7C15ULL + i + 1;
+        BenchResult fec = {latency, 0, 0, 0, 0};
+        if(runFec(&fec, packets, loss, rtt, fecK, fecM) != 0){
+            return 1;
+        }
+        printResult(fecName, loss, &fec, packets);
+    }
+
+    free(latency);
+    return 0;
+}
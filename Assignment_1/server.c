@@ -1,3 +1,5 @@
+// Needed for sendmmsg(), used to answer coalesced GRO reads in one syscall.
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,8 +8,10 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
 
-// Define the port number used for the UDP server.
+// Define the default port number used for the UDP server (can be changed with -p).
 #define PORT 8081
 
 // -----------------------------------------------------------------------------
@@ -97,6 +101,68 @@ typedef struct RejectPacket{
     uint16_t end_packet_identifier;     // Copy of the end packet identifier from the data packet.
 } RejectPacket;
 
+// Forward error correction support (block reassembly and repair).
+#include "fec.h"
+
+// Optional io_uring receive/send engine, selected with -e.
+#include "../Common/udp_uring.h"
+
+// Optional UDP receive coalescing (GRO), enabled with -g.
+#include "../Common/udp_offload.h"
+
+// Optional capture of every received datagram to a trace file, enabled with -w.
+#include "../Common/udp_trace.h"
+
+// Optional sampled per-packet latency tracing with kernel timestamps, enabled with -l.
+#include "../Common/latency_trace.h"
+
+#define LATENCY_SAMPLE_EVERY 1000          // Default for -n: trace one packet in this many.
+
+// Responses collected from one coalesced read before they are sent in a batch.
+#define GRO_MAX_RESPONSES 256
+
+// -----------------------------------------------------------------------------
+// Server State
+// -----------------------------------------------------------------------------
+
+// Either kind of response the server can send back for a data packet.
+typedef union ServerResponse{
+    AckPacket ack;                      // Sent when the data packet passes every check.
+    RejectPacket reject;                // Sent when the data packet fails one of the checks.
+} ServerResponse;
+
+// Buffer large enough for a plain data packet or an FEC packet.
+// Both start with the same header fields, so packet_type can be read from either member.
+typedef union ReceiveBuffer{
+    DataPacket dataPacket;
+    FecPacket fecPacket;
+} ReceiveBuffer;
+
+// Everything the server remembers between packets.
+typedef struct ServerState{
+    int expectedPackNum;                        // The expected segment number to ensure packets are in order.
+    int seq_buffer[MAX_LEN_DATA + 1];           // How many times a packet with a given segment number is received.
+    FecBlock fecBlock;                          // Block currently being reassembled in FEC mode.
+    int lastFecBlock;                           // Last block that was completed and answered in FEC mode.
+    ServerResponse fecResponses[FEC_MAX_K];     // Responses sent for the last completed block.
+    int fecResponseLen[FEC_MAX_K];              // Size in bytes of each cached response.
+    int fecResponseCount;                       // Number of cached responses.
+    int fecOwned;                               // Set once an FEC session has started.
+    uint32_t fecAddress;                        // Source address of the FEC session (network byte order).
+    uint16_t fecPort;                           // Source port of the FEC session (network byte order).
+    uint16_t fecSession;                        // Session id the client put in its FEC packets.
+    int quiet;                                  // Set by -q: do not print every packet.
+    TraceWriter *trace;                         // Capture file given with -w, or NULL.
+} ServerState;
+
+// Set by SIGINT/SIGTERM so the receive loops can stop and print their statistics.
+static volatile sig_atomic_t stopRequested = 0;
+
+void requestStop(int signo){
+    (void)signo;
+    stopRequested = 1;
+}
+
 // -----------------------------------------------------------------------------
 // Helper Functions for Packet Initialization
 // -----------------------------------------------------------------------------
@@ -141,28 +207,322 @@ void displayDataPacket (DataPacket dataPack){
     printf("\n\n\n\n");
 }
 
+// -----------------------------------------------------------------------------
+// Packet Processing
+// -----------------------------------------------------------------------------
+
+// Function to reset the server state before the first packet arrives.
+void initializeServerState(ServerState *state){
+    memset(state, 0, sizeof(ServerState));
+    state->expectedPackNum = 1;
+    state->fecBlock.block_no = -1;
+    state->lastFecBlock = -1;
+}
+
+// Function to validate a data packet and build the ACK or Reject to send back.
+// Returns the size in bytes of the response written to the response buffer.
+int handleDataPacket(ServerState *state, DataPacket *dataPacket, ServerResponse *response){
+    // Determine the actual payload length, without reading past the end of the payload buffer.
+    int payloadLength = strnlen(dataPacket->pload, sizeof(dataPacket->pload));
+
+    // Update the sequence buffer to count how many times this segment number is received.
+    state->seq_buffer[dataPacket->seg_no] += 1;
+
+    // Every outcome moves on to the next expected packet.
+    int expected = state->expectedPackNum++;
+
+    // Check 1: Duplicate Packet
+    // If the packet with this segment number has already been received, it's a duplicate.
+    if(state->seq_buffer[dataPacket->seg_no] != 1){
+        response->reject = initializeReject(*dataPacket);
+        response->reject.rej_sub_code = REJECT_DUPLICATE_PACKET;
+    }
+    // Check 2: Out-of-Sequence Packet
+    // If the segment number does not match the expected sequence number, the packet is out-of-sequence.
+    else if(dataPacket->seg_no != expected){
+        response->reject = initializeReject(*dataPacket);
+        response->reject.rej_sub_code = REJECT_OUT_OF_SEQUENCE;
+    }
+    // Check 3: Payload Length Mismatch
+    // Compare the declared payload length with the actual length calculated.
+    else if(payloadLength != dataPacket->plen){
+        response->reject = initializeReject(*dataPacket);
+        response->reject.rej_sub_code = REJECT_LENGTH_MISMATCH;
+    }
+    // Check 4: End Packet Identifier Verification
+    // Ensure that the end packet identifier in the received packet matches the expected value.
+    else if(dataPacket->end_packet_identifier != END_PACKET_IDENTIFIER){
+        response->reject = initializeReject(*dataPacket);
+        response->reject.rej_sub_code = REJECT_END_OF_PACKET_MISSING;
+    }
+    // All checks passed and the packet was received in the correct order.
+    else{
+        response->ack = initializeAck(*dataPacket);
+        response->ack.received_segment_no = dataPacket->seg_no;
+        return sizeof(AckPacket);
+    }
+
+    response->reject.received_segment_no = dataPacket->seg_no;
+    return sizeof(RejectPacket);
+}
+
+// Function to give the FEC state to a new client session, starting from the first segment again.
+void startFecSession(ServerState *state, const struct sockaddr_in *from, uint16_t session){
+    memset(state->seq_buffer, 0, sizeof(state->seq_buffer));
+    state->expectedPackNum = 1;
+    state->fecBlock.block_no = -1;
+    state->lastFecBlock = -1;
+    state->fecResponseCount = 0;
+    state->fecOwned = 1;
+    state->fecAddress = from->sin_addr.s_addr;
+    state->fecPort = from->sin_port;
+    state->fecSession = session;
+}
+
+// Function to handle a packet received in FEC mode.
+// Packets are collected until their block is complete, rebuilding lost data packets from the repair
+// packets where possible. A completed block is then checked in order like plain data packets.
+// Returns the number of responses written to the responses array.
+int handleFecPacket(ServerState *state, FecPacket *fecPacket, const struct sockaddr_in *from,
+                    ServerResponse responses[], int responseLen[]){
+    FecBlock *block = &state->fecBlock;
+
+    if(!fecValidGeometry(fecPacket->k, fecPacket->m)){
+        return 0;
+    }
+
+    // The block and the cached responses belong to one client run. Block 0 from another source,
+    // or with another session id (a new run behind the same address and port), starts a new
+    // session; any other packet of a different session is a straggler and is ignored.
+    if(!state->fecOwned || from->sin_addr.s_addr != state->fecAddress || from->sin_port != state->fecPort ||
+       fecPacket->session != state->fecSession){
+        if(state->fecOwned && fecPacket->block_no != 0){
+            return 0;
+        }
+        startFecSession(state, from, fecPacket->session);
+    }
+
+    // The client is retransmitting a block that was already answered, so some responses were lost.
+    // Send the same responses again instead of checking the packets a second time.
+    if(fecPacket->block_no == state->lastFecBlock){
+        if(fecPacket->packet_type != FEC_DATA){
+            return 0;
+        }
+        for(int i = 0; i < state->fecResponseCount; i++){
+            responses[i] = state->fecResponses[i];
+            responseLen[i] = state->fecResponseLen[i];
+        }
+        return state->fecResponseCount;
+    }
+
+    // Ignore stragglers from older blocks, and start a new block when the client moves on.
+    if(fecPacket->block_no < state->lastFecBlock){
+        return 0;
+    }
+    if(block->block_no != fecPacket->block_no){
+        fecResetBlock(block, fecPacket->block_no, fecPacket->k, fecPacket->m);
+    }
+
+    if(!fecAddPacket(block, fecPacket)){
+        return 0;
+    }
+    int rebuilt = fecRecover(block);
+    if(rebuilt > 0 && !state->quiet){
+        printf("\nINFO - REBUILT %d PACKET(S) OF BLOCK %d FROM REPAIR DATA.\n", rebuilt, block->block_no);
+    }
+    if(!fecBlockComplete(block)){
+        return 0;
+    }
+
+    // The block is complete: check each data packet in order and remember the responses.
+    for(int i = 0; i < block->k; i++){
+        if(!state->quiet){
+            displayDataPacket(block->data[i]);
+        }
+        responseLen[i] = handleDataPacket(state, &block->data[i], &responses[i]);
+        state->fecResponses[i] = responses[i];
+        state->fecResponseLen[i] = responseLen[i];
+    }
+    state->fecResponseCount = block->k;
+    state->lastFecBlock = block->block_no;
+    block->block_no = -1;
+    return state->fecResponseCount;
+}
+
+// Function to process any received datagram, plain or FEC.
+// Returns the number of responses written to the responses array.
+// The source address identifies the client an FEC block belongs to.
+int processPacket(ServerState *state, const void *packet, int len, const struct sockaddr_in *from,
+                  ServerResponse responses[], int responseLen[]){
+    ReceiveBuffer receiveBuffer;
+    if(len > (int)sizeof(receiveBuffer)){
+        len = sizeof(receiveBuffer);
+    }
+    memset(&receiveBuffer, 0, sizeof(receiveBuffer));
+    memcpy(&receiveBuffer, packet, len);
+
+    // FEC mode: responses are only sent once the packet's block is complete.
+    uint16_t packetType = receiveBuffer.dataPacket.packet_type;
+    if(packetType == FEC_DATA || packetType == FEC_REPAIR){
+        return handleFecPacket(state, &receiveBuffer.fecPacket, from, responses, responseLen);
+    }
+
+    // Display the packet contents for debugging and verification.
+    if(!state->quiet){
+        displayDataPacket(receiveBuffer.dataPacket);
+    }
+
+    // Run the error checks and build the ACK or Reject packet.
+    responseLen[0] = handleDataPacket(state, &receiveBuffer.dataPacket, &responses[0]);
+    return 1;
+}
+
+// Function called by the io_uring engine for every received datagram.
+// Several responses to one packet (a completed FEC block) are linked so they go out in order.
+void handleUringPacket(UdpUring *ring, void *context, void *packet, int len, struct sockaddr_in *from){
+    ServerResponse responses[FEC_MAX_K];
+    int responseLen[FEC_MAX_K];
+    traceWriterAppend(((ServerState *)context)->trace, packet, len, from);
+    int count = processPacket((ServerState *)context, packet, len, from, responses, responseLen);
+    // All or none of a completed block's responses are queued; the client resends the block otherwise.
+    if(count > 1 && udpUringReserve(ring, count) < 0){
+        return;
+    }
+    for(int i = 0; i < count; i++){
+        udpUringSend(ring, &responses[i], responseLen[i], from, i + 1 < count);
+    }
+}
+
+// Function to split a coalesced GRO read back into individual datagrams and answer each of them.
+// The responses are sent back in batches instead of one sendto() per datagram.
+// Returns the number of datagrams in the read, and adds the syscalls used to *syscalls.
+int handleGroRead(int sockfd, ServerState *state, unsigned char *buffer, int len, int segSize,
+                  struct sockaddr_in *from, socklen_t fromLen, long *syscalls){
+    static ServerResponse responses[GRO_MAX_RESPONSES];
+    static int responseLen[GRO_MAX_RESPONSES];
+    void *responsePointers[GRO_MAX_RESPONSES];
+    int count = 0;
+    int datagrams = 0;
+
+    // Without a segment size the read holds a single datagram.
+    if(segSize <= 0){
+        segSize = len;
+    }
+    for(int offset = 0; offset < len; offset += segSize){
+        int segmentLen = (len - offset < segSize) ? len - offset : segSize;
+        traceWriterAppend(state->trace, buffer + offset, segmentLen, from);
+        count += processPacket(state, buffer + offset, segmentLen, from, &responses[count], &responseLen[count]);
+        datagrams++;
+
+        // Flush before a completed FEC block could overflow the batch.
+        if(count + FEC_MAX_K > GRO_MAX_RESPONSES || offset + segSize >= len){
+            for(int i = 0; i < count; i++){
+                responsePointers[i] = &responses[i];
+            }
+            *syscalls += udpSendBatch(sockfd, responsePointers, responseLen, count, (struct sockaddr *)from, fromLen);
+            count = 0;
+        }
+    }
+    return datagrams;
+}
+
+// Function to finish the capture file, if one is being written.
+void closeCapture(ServerState *state){
+    if(state->trace != NULL){
+        printf("Captured: %ld packets\n", state->trace->records);
+        traceWriterClose(state->trace);
+        state->trace = NULL;
+    }
+}
+
 // -----------------------------------------------------------------------------
 // Main Function: Server Setup and Packet Handling Loop
 // -----------------------------------------------------------------------------
 
-int main(){
+// ../Tools/trace_replay.c includes this file with SERVER_NO_MAIN defined to call processPacket() directly.
+#ifndef SERVER_NO_MAIN
+int main(int argc, char *argv[]){
     
-    // Declare instances for storing incoming data packets, and packets to be sent as ACK or Reject.
-    DataPacket dataPacket;
-    AckPacket ackPacket;
-    RejectPacket rejectPacket;
+    // Declare instances for storing incoming packets, and the ACK or Reject packets to be sent back.
+    ReceiveBuffer receiveBuffer;
+    ServerResponse responses[FEC_MAX_K];
+    int responseLen[FEC_MAX_K];
 
     // Set up the server address structure.
     struct sockaddr_in serverAddress;
     socklen_t serverAddrLen;
     int sockfd;
     
-    // This variable tracks the expected segment number to ensure packets are in order.
-    int expectedPackNum = 1;
-    
-    // Buffer array to keep track of how many times a packet with a given segment number is received.
-    int seq_buffer[50] = {0};
+    // Sequence tracking and FEC reassembly state.
+    ServerState state;
+    initializeServerState(&state);
     int time_temp = 0;
+    int port = PORT;
+    const char *engine = "classic";
+    int useGro = 0;
+    const char *capturePath = NULL;
+    TraceWriter trace;
+    const char *latencyPath = NULL;
+    unsigned sampleEvery = LATENCY_SAMPLE_EVERY;
+    LatencyTracer tracer;
+    int option;
+
+    // Counters printed when the server is stopped.
+    long packetsReceived = 0;
+    long syscalls = 0;
+
+    // -----------------------------
+    // Command Line Options
+    // -----------------------------
+
+    // -p PORT listens on a different port, e.g. behind the impairment proxy in ../Tools.
+    // -e ENGINE selects the I/O backend: classic (recvfrom/sendto), uring, or uring-sqpoll.
+    // -q stops printing every packet, for load tests.
+    // -g asks the kernel to coalesce received datagrams (UDP GRO, Linux, classic engine only).
+    // -w FILE records every received datagram to FILE for ../Tools/trace_replay.
+    // -l FILE traces the latency of sampled packets and writes them to FILE as Chrome trace JSON on exit.
+    // -n N traces one packet in N with -l (default 1000).
+    while((option = getopt(argc, argv, "p:e:qgw:l:n:")) != -1){
+        if(option == 'p'){
+            port = atoi(optarg);
+        }else if(option == 'e'){
+            engine = optarg;
+        }else if(option == 'q'){
+            state.quiet = 1;
+        }else if(option == 'g'){
+            useGro = 1;
+        }else if(option == 'w'){
+            capturePath = optarg;
+        }else if(option == 'l'){
+            latencyPath = optarg;
+        }else if(option == 'n'){
+            if(atoi(optarg) < 1){
+                printf("\nERROR - -n NEEDS TO TRACE ONE PACKET IN AT LEAST 1.\n");
+                exit(1);
+            }
+            sampleEvery = (unsigned)atoi(optarg);
+        }else{
+            printf("Usage: %s [-p port] [-e classic|uring|uring-sqpoll] [-q] [-g] [-w capture_file] [-l latency_file] [-n sample_every]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    // Open the capture file before any packet can arrive.
+    if(capturePath != NULL){
+        if(traceWriterOpen(&trace, capturePath) < 0){
+            printf("\nERROR - THE CAPTURE FILE %s COULD NOT BE CREATED.\n", capturePath);
+            exit(1);
+        }
+        state.trace = &trace;
+    }
+
+    // Stop cleanly on Ctrl-C so the statistics can be printed.
+    // SA_RESTART is left out so a blocking recvfrom() returns when the signal arrives.
+    struct sigaction stopAction;
+    memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = requestStop;
+    sigaction(SIGINT, &stopAction, NULL);
+    sigaction(SIGTERM, &stopAction, NULL);
 
     // -----------------------------
     // Socket Creation and Binding
@@ -182,7 +542,7 @@ int main(){
     // Allow the server to receive packets from any IP address.
     serverAddress.sin_addr.s_addr = INADDR_ANY;
     // Set the port number, converting it to network byte order.
-    serverAddress.sin_port = htons(PORT);
+    serverAddress.sin_port = htons(port);
     serverAddrLen = sizeof(serverAddress);
 
     // Bind the socket to the server address so that it can listen for incoming packets.
@@ -190,78 +550,111 @@ int main(){
     // At this point, the server is set up and ready to receive data packets.
 
     // -----------------------------
-    // Main Loop: Receiving and Processing Packets
+    // io_uring Backend
     // -----------------------------
 
-    // Loop indefinitely to continuously receive packets from the client.
-    while(10){
-        // Receive a data packet from the client.
-        // The recvfrom function fills the dataPacket structure with the incoming packet data.
-        time_temp = recvfrom(sockfd, &dataPacket, sizeof(DataPacket), 0, (struct sockaddr *)&serverAddress, &serverAddrLen);
-        
-        // Display the packet contents for debugging and verification.
-        displayDataPacket(dataPacket);
-
-        // Determine the actual payload length using strlen, which calculates the length of the payload string.
-        int payloadLength = strlen(dataPacket.pload);
-
-        // Update the sequence buffer to count how many times this segment number is received.
-        seq_buffer[dataPacket.seg_no] += 1;
-        
-        // -----------------------------
-        // Error Checking and Handling
-        // -----------------------------
-        
-        // Check 1: Duplicate Packet
-        // If the packet with this segment number has already been received, it's a duplicate.
-        if(seq_buffer[dataPacket.seg_no] != 1){
-            // Initialize a Reject packet based on the received data packet.
-            rejectPacket = initializeReject(dataPacket);
-            // Set the reject sub-code to indicate a duplicate packet error.
-            rejectPacket.rej_sub_code = REJECT_DUPLICATE_PACKET;
-            // Send the Reject packet back to the client.
-            sendto(sockfd, &rejectPacket, sizeof(rejectPacket), 0, (struct sockaddr *)&serverAddress, serverAddrLen);
-            // Increment expectedPackNum to move on to the next expected packet.
-            expectedPackNum++;
+    if(strcmp(engine, "uring") == 0 || strcmp(engine, "uring-sqpoll") == 0){
+        UdpUring ring;
+        if(useGro){
+            printf("\nINFO - GRO IS ONLY USED WITH THE CLASSIC ENGINE.\n");
         }
-        // Check 2: Out-of-Sequence Packet
-        // If the segment number does not match the expected sequence number, the packet is out-of-sequence.
-        else if(dataPacket.seg_no != expectedPackNum){
-            rejectPacket = initializeReject(dataPacket);
-            // Set the reject sub-code for an out-of-sequence error.
-            rejectPacket.rej_sub_code = REJECT_OUT_OF_SEQUENCE;
-            sendto(sockfd, &rejectPacket, sizeof(rejectPacket), 0, (struct sockaddr *)&serverAddress, serverAddrLen);
-            expectedPackNum++;
+        if(latencyPath != NULL){
+            printf("\nINFO - LATENCY TRACING IS ONLY USED WITH THE CLASSIC ENGINE.\n");
         }
-        // Check 3: Payload Length Mismatch
-        // Compare the declared payload length with the actual length calculated.
-        else if(payloadLength != dataPacket.plen){
-            rejectPacket = initializeReject(dataPacket);
-            // Set the reject sub-code for a payload length mismatch error.
-            rejectPacket.rej_sub_code = REJECT_LENGTH_MISMATCH;
-            sendto(sockfd, &rejectPacket, sizeof(rejectPacket), 0, (struct sockaddr *)&serverAddress, serverAddrLen);
-            expectedPackNum++;
+        if(udpUringInit(&ring, sockfd, strcmp(engine, "uring-sqpoll") == 0) == 0){
+            if(udpUringRun(&ring, handleUringPacket, &state, &stopRequested) < 0){
+                printf("\nERROR - THE IO_URING ENGINE FAILED.\n");
+            }
+            printf("\nEngine: %s  Packets: %ld  Responses: %ld  Dropped responses: %ld  Syscalls: %ld (%.3f per packet)\n",
+                   engine, ring.packets, ring.responses, ring.sendDrops, ring.syscalls,
+                   ring.packets > 0 ? (double)ring.syscalls / ring.packets : 0.0);
+            udpUringClose(&ring);
+            closeCapture(&state);
+            return 0;
         }
-        // Check 4: End Packet Identifier Verification
-        // Ensure that the end packet identifier in the received packet matches the expected value.
-        else if(dataPacket.end_packet_identifier != END_PACKET_IDENTIFIER){
-            rejectPacket = initializeReject(dataPacket);
-            // Set the reject sub-code for a missing or incorrect end packet identifier.
-            rejectPacket.rej_sub_code = REJECT_END_OF_PACKET_MISSING;
-            sendto(sockfd, &rejectPacket, sizeof(rejectPacket), 0, (struct sockaddr *)&serverAddress, serverAddrLen);
-            expectedPackNum++;
+        printf("\nINFO - IO_URING IS NOT AVAILABLE, USING THE CLASSIC ENGINE.\n");
+        engine = "classic";
+    }else if(strcmp(engine, "classic") != 0){
+        printf("\nERROR - UNKNOWN ENGINE %s.\n", engine);
+        exit(1);
+    }
+
+    // Turn on receive coalescing, or carry on with one datagram per read if the kernel does not support it.
+    if(useGro && udpGroEnable(sockfd) < 0){
+        printf("\nINFO - UDP GRO IS NOT AVAILABLE, RECEIVING PACKETS ONE BY ONE.\n");
+        useGro = 0;
+    }
+    // Latency tracing follows single datagrams, so it is not combined with GRO.
+    if(latencyPath != NULL && useGro){
+        printf("\nINFO - LATENCY TRACING IS NOT USED WITH GRO.\n");
+        latencyPath = NULL;
+    }
+    if(latencyTracerInit(&tracer, sockfd, latencyPath != NULL ? sampleEvery : 0) < 0){
+        printf("\nERROR - OUT OF MEMORY FOR THE LATENCY TRACE.\n");
+        exit(1);
+    }
+    if(tracer.enabled && !tracer.kernelTimestamps){
+        printf("\nINFO - KERNEL TIMESTAMPS ARE NOT AVAILABLE, TRACING USER SPACE STAGES ONLY.\n");
+    }
+    static unsigned char groBuffer[UDP_GRO_BUFFER_SIZE];
+    char groControl[CMSG_SPACE(sizeof(int))];
+    struct iovec groIov = {groBuffer, sizeof(groBuffer)};
+
+    // -----------------------------
+    // Main Loop: Receiving and Processing Packets
+    // -----------------------------
+
+    // Loop until stopped to continuously receive packets from the client.
+    while(!stopRequested){
+        // GRO: one read may hold many datagrams from the same client.
+        if(useGro){
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_name = &serverAddress;
+            msg.msg_namelen = sizeof(serverAddress);
+            msg.msg_iov = &groIov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = groControl;
+            msg.msg_controllen = sizeof(groControl);
+            time_temp = recvmsg(sockfd, &msg, 0);
+            syscalls++;
+            if(time_temp > 0){
+                packetsReceived += handleGroRead(sockfd, &state, groBuffer, time_temp, udpGroSegmentSize(&msg),
+                                                 &serverAddress, msg.msg_namelen, &syscalls);
+            }
+            continue;
         }
-        // If all checks pass and the packet is received in the correct order.
-        else if(dataPacket.seg_no == expectedPackNum){ 
-            // Initialize an ACK packet to acknowledge the correct reception.
-            ackPacket = initializeAck(dataPacket);
-            // Send the ACK packet back to the client.
-            sendto(sockfd, &ackPacket, sizeof(ackPacket), 0, (struct sockaddr *)&serverAddress, serverAddrLen);
-            // Increment expectedPackNum for the next packet.
-            expectedPackNum++;
+
+        // Receive a packet from the client.
+        // The recvfrom function fills the receive buffer with either a plain data packet or an FEC packet.
+        // With -l it is a recvmsg() that also returns the kernel receive timestamp of sampled packets.
+        serverAddrLen = sizeof(serverAddress);
+        time_temp = latencyRecvFrom(&tracer, sockfd, &receiveBuffer, sizeof(receiveBuffer), &serverAddress, &serverAddrLen);
+        syscalls++;
+        if(time_temp < 0){
+            continue;
+        }
+        packetsReceived++;
+        traceWriterAppend(state.trace, &receiveBuffer, time_temp, &serverAddress);
+
+        // Check the packet and send every response back to the client.
+        latencyStamp(LATENCY_PROCESS_START);
+        int count = processPacket(&state, &receiveBuffer, time_temp, &serverAddress, responses, responseLen);
+        latencyStamp(LATENCY_PROCESS_END);
+        for(int i = 0; i < count; i++){
+            latencySendTo(&tracer, sockfd, &responses[i], responseLen[i], &serverAddress, serverAddrLen);
+            syscalls++;
         }
-        
+        latencyEndPacket(&tracer, sockfd);
     }
 
+    printf("\nEngine: %s  Packets: %ld  Syscalls: %ld (%.3f per packet)\n", engine, packetsReceived, syscalls,
+           packetsReceived > 0 ? (double)syscalls / packetsReceived : 0.0);
+    closeCapture(&state);
+    if(latencyPath != NULL && latencyExport(&tracer, latencyPath) < 0){
+        printf("\nERROR - THE LATENCY TRACE %s COULD NOT BE WRITTEN.\n", latencyPath);
+    }
+    latencyTracerFree(&tracer);
     return 0;
 }
+#endif
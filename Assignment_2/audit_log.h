@@ -0,0 +1,441 @@
+// -----------------------------------------------------------------------------
+// Durable Audit Log of Authorization Decisions
+// -----------------------------------------------------------------------------
+//
+// Every ACCESS_OK, NOT_PAID and NOT_EXIST answer is recorded as a fixed 32-byte
+// record in an append-only log made of numbered segment files in one directory.
+//
+// - Each thread that records decisions gets its own single-producer ring buffer,
+//   so recording is a copy and a release store, with no lock and no syscall.
+// - One writer thread drains all rings, appends the records to the current
+//   segment with one write() per batch, and calls fdatasync() at most once per
+//   durability window (group commit). With a window of 0 every batch is synced
+//   before the writer looks for more records.
+// - A segment is closed when it reaches the size limit or the age limit. Its
+//   header then gets the lowest and highest timestamp it holds, so the scanner can
+//   skip whole segments for time-range queries.
+// - Every record carries a checksum, so a record torn by a crash is detected and
+//   skipped instead of being misread.
+//
+// If a producer's ring is full (the disk cannot keep up), the producer waits for
+// the writer rather than dropping decisions; such waits are counted as stalls.
+// A batch taken from the rings is kept until it is completely written. If a write
+// stops short (disk full, file too large), the segment is cut back to its last
+// whole record and closed, and the rest of the batch goes to the next segment.
+// When not even an empty segment can take a record, the writer marks itself as
+// failing and retries later. Producers do not wait on a failing writer, and wait
+// at most AUDIT_STALL_LIMIT_US on a slow one: the decision is then counted as lost
+// instead of holding up the answer to the client.
+//
+// Needs POSIX threads (compile with -pthread).
+
+#ifndef AUDIT_LOG_H
+#define AUDIT_LOG_H
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define AUDIT_MAGIC "AUDITLG1"            // First 8 bytes of every segment.
+#define AUDIT_VERSION 1
+#define AUDIT_RING_SIZE 16384             // Records per producer ring (power of two).
+#define AUDIT_MAX_PRODUCERS 64            // Threads that can record decisions.
+#define AUDIT_WRITE_BATCH 4096            // Records per write().
+#define AUDIT_IDLE_WAIT_US 1000           // Writer sleep when there is nothing to write.
+#define AUDIT_RETRY_WAIT_US 100000        // Writer sleep after a failed open or write.
+#define AUDIT_STALL_LIMIT_US 1000000      // Longest a producer waits for room in its ring.
+
+typedef struct AuditSegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sealed;                      // 1 once the segment is closed and the timestamps below are final.
+    uint64_t firstNs;                     // Lowest record timestamp in the segment (sealed segments only).
+    uint64_t lastNs;                      // Highest record timestamp in the segment (sealed segments only).
+} AuditSegmentHeader;
+
+typedef struct AuditRecord {
+    uint64_t timestampNs;                 // Decision time, CLOCK_REALTIME.
+    uint64_t subscriber;                  // Subscriber number from the request.
+    uint32_t address;                     // Client IPv4 address, network byte order.
+    uint16_t port;                        // Client port, network byte order.
+    uint16_t decision;                    // ACCESS_OK, NOT_PAID or NOT_EXIST.
+    uint8_t technology;                   // Technology from the request.
+    uint8_t reserved[3];
+    uint32_t checksum;                    // auditChecksum() of the bytes above.
+} AuditRecord;
+
+// Ring buffer owned by one producer thread.
+typedef struct AuditRing {
+    _Atomic uint64_t head;                // Next slot the producer writes.
+    char pad1[56];
+    _Atomic uint64_t tail;                // Next slot the writer reads.
+    char pad2[56];
+    AuditRecord records[AUDIT_RING_SIZE];
+} AuditRing;
+
+typedef struct AuditLog {
+    char directory[256];
+    uint64_t durabilityNs;                // Longest time a written record may wait for fdatasync().
+    uint64_t segmentBytes;                // Rotate after this many bytes.
+    uint64_t segmentNs;                   // Rotate after this long.
+    _Atomic(AuditRing *) rings[AUDIT_MAX_PRODUCERS];
+    _Atomic int ringCount;                // Slots handed out; may exceed AUDIT_MAX_PRODUCERS after failed registrations.
+    _Atomic int stopping;
+    _Atomic int failing;                  // Set while the writer cannot write; producers then drop instead of waiting.
+    pthread_t writer;
+    AuditRecord *batch;                   // Writer's buffer of AUDIT_WRITE_BATCH records.
+    int fd;                               // Current segment.
+    unsigned segmentNumber;
+    uint64_t segmentSize;
+    uint64_t segmentOpenedNs;
+    uint64_t segmentFirstNs, segmentLastNs;
+    _Atomic long records;                 // Records written to disk.
+    _Atomic long syncs;                   // fdatasync() calls.
+    _Atomic long segments;                // Segments created.
+    _Atomic long stalls;                  // Times a producer found its ring full.
+    _Atomic long errors;                  // Failed opens, writes or syncs.
+    _Atomic long lost;                    // Records dropped for a failing or stalled writer, or left at close.
+} AuditLog;
+
+// Ring of the calling thread, registered on first use.
+static __thread AuditRing *auditThreadRing;
+
+static inline uint64_t auditNowNs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// FNV-1a over the record without its checksum field.
+static inline uint32_t auditChecksum(const AuditRecord *record) {
+    const unsigned char *bytes = (const unsigned char *)record;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(AuditRecord, checksum); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Write the header at the start of the current segment.
+static inline int auditWriteHeader(AuditLog *log, int sealed) {
+    AuditSegmentHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AUDIT_MAGIC, sizeof(header.magic));
+    header.version = AUDIT_VERSION;
+    header.sealed = sealed;
+    header.firstNs = sealed ? log->segmentFirstNs : 0;
+    header.lastNs = sealed ? log->segmentLastNs : 0;
+    return pwrite(log->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) ? 0 : -1;
+}
+
+// Path of the current segment file.
+static inline void auditSegmentPath(const AuditLog *log, char *path, size_t size) {
+    snprintf(path, size, "%s/audit-%08u.log", log->directory, log->segmentNumber);
+}
+
+// Start the next segment file. Returns 0 on success.
+static inline int auditOpenSegment(AuditLog *log) {
+    char path[320];
+    auditSegmentPath(log, path, sizeof(path));
+    log->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log->fd < 0) {
+        return -1;
+    }
+    // Records are appended with write() after the header, which is rewritten in place with pwrite().
+    // A segment whose header cannot be written is removed, and the same number is tried again later.
+    if (auditWriteHeader(log, 0) < 0 || lseek(log->fd, sizeof(AuditSegmentHeader), SEEK_SET) < 0) {
+        close(log->fd);
+        unlink(path);
+        log->fd = -1;
+        return -1;
+    }
+    log->segmentSize = sizeof(AuditSegmentHeader);
+    log->segmentOpenedNs = auditNowNs(CLOCK_MONOTONIC);
+    log->segmentFirstNs = UINT64_MAX;
+    log->segmentLastNs = 0;
+    atomic_fetch_add(&log->segments, 1);
+    return 0;
+}
+
+// Append bytes to the current segment, continuing after short writes.
+// Returns how many bytes were written, which is less than bytes if the segment cannot take them all.
+static inline size_t auditWriteAll(AuditLog *log, const void *data, size_t bytes) {
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t written = write(log->fd, (const char *)data + done, bytes - done);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            break;
+        }
+        done += written;
+    }
+    return done;
+}
+
+// Sync, seal and close the current segment.
+static inline void auditCloseSegment(AuditLog *log) {
+    if (log->fd < 0) {
+        return;
+    }
+    if (log->segmentLastNs == 0) {
+        log->segmentFirstNs = 0;
+    }
+    if (auditWriteHeader(log, 1) < 0 || fdatasync(log->fd) < 0) {
+        atomic_fetch_add(&log->errors, 1);
+    }
+    atomic_fetch_add(&log->syncs, 1);
+    close(log->fd);
+    log->fd = -1;
+    log->segmentNumber++;
+}
+
+// Move up to AUDIT_WRITE_BATCH records from the rings into batch. Returns how many.
+static inline int auditCollect(AuditLog *log, AuditRecord batch[]) {
+    int collected = 0;
+    int rings = atomic_load_explicit(&log->ringCount, memory_order_acquire);
+    if (rings > AUDIT_MAX_PRODUCERS) {
+        rings = AUDIT_MAX_PRODUCERS;
+    }
+    for (int r = 0; r < rings && collected < AUDIT_WRITE_BATCH; r++) {
+        // A slot that was just claimed may not have its ring yet.
+        AuditRing *ring = atomic_load_explicit(&log->rings[r], memory_order_acquire);
+        if (ring == NULL) {
+            continue;
+        }
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (tail < head && collected < AUDIT_WRITE_BATCH) {
+            batch[collected++] = ring->records[tail & (AUDIT_RING_SIZE - 1)];
+            tail++;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    return collected;
+}
+
+// Count the batch and everything still in the rings as lost, when the writer has to give up at close.
+static inline void auditCountLost(AuditLog *log, AuditRecord batch[], int count) {
+    do {
+        atomic_fetch_add(&log->lost, count);
+    } while ((count = auditCollect(log, batch)) > 0);
+}
+
+static inline void *auditWriterMain(void *arg) {
+    AuditLog *log = arg;
+    AuditRecord *batch = log->batch;
+    uint64_t lastSync = auditNowNs(CLOCK_MONOTONIC);
+    int unsynced = 0;
+    int count = 0;                        // Records in batch still to be written.
+
+    while (1) {
+        int stopping = atomic_load(&log->stopping);
+        if (count == 0) {
+            count = auditCollect(log, batch);
+        }
+        uint64_t now = auditNowNs(CLOCK_MONOTONIC);
+
+        // Rotate before writing, so a batch never straddles two segments.
+        if (log->fd >= 0 && (log->segmentSize >= log->segmentBytes || now - log->segmentOpenedNs >= log->segmentNs) &&
+            log->segmentSize > sizeof(AuditSegmentHeader)) {
+            auditCloseSegment(log);
+            unsynced = 0;
+            lastSync = now;
+        }
+
+        // The batch stays in memory until a segment can be opened; only a close gives up on it.
+        if (log->fd < 0 && auditOpenSegment(log) < 0) {
+            atomic_fetch_add(&log->errors, 1);
+            atomic_store(&log->failing, 1);
+            if (stopping) {
+                auditCountLost(log, batch, count);
+                break;
+            }
+            usleep(AUDIT_RETRY_WAIT_US);
+            continue;
+        }
+
+        if (count > 0) {
+            int whole = auditWriteAll(log, batch, sizeof(AuditRecord) * count) / sizeof(AuditRecord);
+            for (int i = 0; i < whole; i++) {
+                if (batch[i].timestampNs < log->segmentFirstNs) {
+                    log->segmentFirstNs = batch[i].timestampNs;
+                }
+                if (batch[i].timestampNs > log->segmentLastNs) {
+                    log->segmentLastNs = batch[i].timestampNs;
+                }
+            }
+            log->segmentSize += sizeof(AuditRecord) * whole;
+            atomic_fetch_add(&log->records, whole);
+            unsynced |= whole > 0;
+
+            if (whole < count) {
+                // Cut off a partly written record and keep the rest of the batch for the next segment.
+                atomic_fetch_add(&log->errors, 1);
+                if (ftruncate(log->fd, log->segmentSize) < 0 || lseek(log->fd, log->segmentSize, SEEK_SET) < 0) {
+                    atomic_fetch_add(&log->errors, 1);
+                }
+                count -= whole;
+                memmove(batch, batch + whole, sizeof(AuditRecord) * count);
+                if (log->segmentSize > sizeof(AuditSegmentHeader)) {
+                    auditCloseSegment(log);
+                    unsynced = 0;
+                    lastSync = now;
+                    continue;
+                }
+                atomic_store(&log->failing, 1);
+                if (stopping) {
+                    auditCountLost(log, batch, count);
+                    break;
+                }
+                usleep(AUDIT_RETRY_WAIT_US);
+                continue;
+            }
+        }
+        atomic_store(&log->failing, 0);
+
+        // Group commit: one fdatasync() covers everything written since the last one.
+        if (unsynced && now - lastSync >= log->durabilityNs) {
+            if (fdatasync(log->fd) < 0) {
+                atomic_fetch_add(&log->errors, 1);
+            }
+            atomic_fetch_add(&log->syncs, 1);
+            lastSync = now;
+            unsynced = 0;
+        }
+
+        if (count == 0) {
+            if (stopping) {
+                break;
+            }
+            usleep(AUDIT_IDLE_WAIT_US);
+        }
+        count = 0;
+    }
+    auditCloseSegment(log);
+    return NULL;
+}
+
+// Find the first unused segment number in the directory, so a restart appends new segments.
+static inline unsigned auditNextSegmentNumber(const char *directory) {
+    unsigned next = 0;
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        return 0;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned number;
+        if (sscanf(entry->d_name, "audit-%8u.log", &number) == 1 && number + 1 > next) {
+            next = number + 1;
+        }
+    }
+    closedir(dir);
+    return next;
+}
+
+// Open the log in directory (created if needed) and start the writer thread. Returns 0 on success.
+static inline int auditLogOpen(AuditLog *log, const char *directory, double durabilityMs, double segmentMb, double segmentSeconds) {
+    memset(log, 0, sizeof(*log));
+    snprintf(log->directory, sizeof(log->directory), "%s", directory);
+    log->durabilityNs = (uint64_t)(durabilityMs * 1e6);
+    log->segmentBytes = (uint64_t)(segmentMb * 1024 * 1024);
+    log->segmentNs = (uint64_t)(segmentSeconds * 1e9);
+    log->fd = -1;
+    if (mkdir(directory, 0755) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    log->segmentNumber = auditNextSegmentNumber(directory);
+    // Allocated here, so a writer that could not run shows up as an open error.
+    log->batch = malloc(sizeof(AuditRecord) * AUDIT_WRITE_BATCH);
+    if (log->batch == NULL) {
+        return -1;
+    }
+    if (auditOpenSegment(log) < 0) {
+        free(log->batch);
+        return -1;
+    }
+
+    // The writer must not take SIGINT/SIGTERM away from the thread waiting in recvfrom().
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    int result = pthread_create(&log->writer, NULL, auditWriterMain, log);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (result != 0) {
+        char path[320];
+        auditSegmentPath(log, path, sizeof(path));
+        close(log->fd);
+        unlink(path);
+        free(log->batch);
+        return -1;
+    }
+    return 0;
+}
+
+// Record one decision from the calling thread. Returns 0, or -1 if no more threads can register or
+// the decision was dropped because the writer is failing or did not make room in time.
+static inline int auditLogRecord(AuditLog *log, uint64_t subscriber, uint8_t technology, uint16_t decision,
+                                 uint32_t address, uint16_t port) {
+    AuditRing *ring = auditThreadRing;
+    if (ring == NULL) {
+        int slot = atomic_fetch_add(&log->ringCount, 1);
+        if (slot >= AUDIT_MAX_PRODUCERS || (ring = calloc(1, sizeof(AuditRing))) == NULL) {
+            return -1;
+        }
+        atomic_store_explicit(&log->rings[slot], ring, memory_order_release);
+        auditThreadRing = ring;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= AUDIT_RING_SIZE) {
+        atomic_fetch_add(&log->stalls, 1);
+        uint64_t giveUp = auditNowNs(CLOCK_MONOTONIC) + AUDIT_STALL_LIMIT_US * 1000ULL;
+        while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= AUDIT_RING_SIZE) {
+            if (atomic_load(&log->failing) || auditNowNs(CLOCK_MONOTONIC) >= giveUp) {
+                atomic_fetch_add(&log->lost, 1);
+                return -1;
+            }
+            sched_yield();
+        }
+    }
+    AuditRecord *record = &ring->records[head & (AUDIT_RING_SIZE - 1)];
+    memset(record, 0, sizeof(*record));
+    record->timestampNs = auditNowNs(CLOCK_REALTIME);
+    record->subscriber = subscriber;
+    record->address = address;
+    record->port = port;
+    record->decision = decision;
+    record->technology = technology;
+    record->checksum = auditChecksum(record);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 0;
+}
+
+// Write out everything recorded so far, seal the last segment and stop the writer.
+static inline void auditLogClose(AuditLog *log) {
+    atomic_store(&log->stopping, 1);
+    pthread_join(log->writer, NULL);
+    free(log->batch);
+    log->batch = NULL;
+    for (int r = 0; r < AUDIT_MAX_PRODUCERS; r++) {
+        free(atomic_exchange(&log->rings[r], NULL));
+    }
+}
+
+#endif
@@ -0,0 +1,207 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "audit_log.h"
+
+// -----------------------------------------------------------------------------
+// Audit Log Scanner
+// -----------------------------------------------------------------------------
+//
+// Prints (or counts) the decisions in an audit log directory written by
+// "./server -a DIR", optionally only those of one subscriber and/or inside a time
+// range. Segments are memory-mapped and scanned in order. A sealed segment whose
+// timestamp range lies outside the query is skipped without being read. Records
+// with a bad checksum (torn by a crash) are skipped and counted.
+//
+// Times are seconds since the epoch (fractions allowed) or UTC as YYYY-MM-DDTHH:MM:SS.
+//
+// Compile: gcc -O2 -pthread audit_scan.c -o audit_scan
+// Run:     ./audit_scan -s 7867098787 -f 2026-10-18T08:00:00 -t 2026-10-18T09:00:00 audit
+//          ./audit_scan -c audit
+
+// Decision codes, as in server.c.
+#define ACCESS_OK 0XFFFB
+#define NOT_PAID 0XFFF9
+#define NOT_EXIST 0XFFFA
+
+#define MAX_SEGMENTS 100000
+
+static void usage(const char *program) {
+    printf("Usage: %s [-s subscriber] [-f from] [-t to] [-c] audit_dir\n", program);
+    exit(1);
+}
+
+// Parse a time given as epoch seconds or YYYY-MM-DDTHH:MM:SS (UTC). Returns nanoseconds since the epoch.
+static uint64_t parseTime(const char *text, const char *program) {
+    struct tm parts;
+    memset(&parts, 0, sizeof(parts));
+    const char *rest = strptime(text, "%Y-%m-%dT%H:%M:%S", &parts);
+    if (rest != NULL && *rest == '\0') {
+        return (uint64_t)timegm(&parts) * 1000000000ULL;
+    }
+    char *end;
+    double seconds = strtod(text, &end);
+    if (*end != '\0' || seconds < 0) {
+        usage(program);
+    }
+    return (uint64_t)(seconds * 1e9);
+}
+
+static const char *decisionName(uint16_t decision) {
+    if (decision == ACCESS_OK) {
+        return "ACCESS_OK";
+    } else if (decision == NOT_PAID) {
+        return "NOT_PAID";
+    } else if (decision == NOT_EXIST) {
+        return "NOT_EXIST";
+    }
+    return "UNKNOWN";
+}
+
+static void printRecord(const AuditRecord *record) {
+    time_t seconds = (time_t)(record->timestampNs / 1000000000ULL);
+    struct tm parts;
+    char when[32];
+    char address[INET_ADDRSTRLEN];
+    struct in_addr in;
+    gmtime_r(&seconds, &parts);
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &parts);
+    in.s_addr = record->address;
+    inet_ntop(AF_INET, &in, address, sizeof(address));
+    printf("%s.%09lluZ %llu tech=%u %s %s:%u\n", when, (unsigned long long)(record->timestampNs % 1000000000ULL),
+           (unsigned long long)record->subscriber, record->technology, decisionName(record->decision), address,
+           ntohs(record->port));
+}
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t from = 0, to = UINT64_MAX;
+    unsigned long long subscriber = 0;
+    int filterSubscriber = 0;
+    int countOnly = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:f:t:c")) != -1) {
+        if (option == 's') {
+            subscriber = strtoull(optarg, NULL, 10);
+            filterSubscriber = 1;
+        } else if (option == 'f') {
+            from = parseTime(optarg, argv[0]);
+        } else if (option == 't') {
+            to = parseTime(optarg, argv[0]);
+        } else if (option == 'c') {
+            countOnly = 1;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+    }
+    const char *directory = argv[optind];
+
+    // Segment names sort in the order they were written.
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        printf("\nERROR - THE AUDIT DIRECTORY %s COULD NOT BE OPENED.\n", directory);
+        return 1;
+    }
+    static char *names[MAX_SEGMENTS];
+    int segmentCount = 0;
+    struct dirent *entry;
+    unsigned number;
+    while ((entry = readdir(dir)) != NULL && segmentCount < MAX_SEGMENTS) {
+        if (sscanf(entry->d_name, "audit-%8u.log", &number) == 1) {
+            names[segmentCount++] = strdup(entry->d_name);
+        }
+    }
+    closedir(dir);
+    qsort(names, segmentCount, sizeof(char *), compareNames);
+
+    long scanned = 0, skipped = 0, records = 0, matches = 0, torn = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int s = 0; s < segmentCount; s++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", directory, names[s]);
+        int fd = open(path, O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(AuditSegmentHeader)) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            continue;
+        }
+        AuditSegmentHeader header;
+        if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            memcmp(header.magic, AUDIT_MAGIC, sizeof(header.magic)) != 0) {
+            close(fd);
+            continue;
+        }
+
+        // A sealed segment knows its time range; an empty sealed segment has none.
+        if (header.sealed && (header.lastNs == 0 || header.lastNs < from || header.firstNs > to)) {
+            skipped++;
+            close(fd);
+            continue;
+        }
+        size_t count = (info.st_size - sizeof(AuditSegmentHeader)) / sizeof(AuditRecord);
+        if (count == 0) {
+            close(fd);
+            continue;
+        }
+        unsigned char *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            continue;
+        }
+        madvise(data, info.st_size, MADV_SEQUENTIAL);
+        scanned++;
+
+        const AuditRecord *segmentRecords = (const AuditRecord *)(data + sizeof(AuditSegmentHeader));
+        for (size_t i = 0; i < count; i++) {
+            const AuditRecord *record = &segmentRecords[i];
+            if ((filterSubscriber && record->subscriber != subscriber) || record->timestampNs < from ||
+                record->timestampNs > to) {
+                continue;
+            }
+            // Only records that would be reported are checksummed.
+            if (record->checksum != auditChecksum(record)) {
+                torn++;
+                continue;
+            }
+            matches++;
+            if (!countOnly) {
+                printRecord(record);
+            }
+        }
+        records += count;
+        munmap(data, info.st_size);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (countOnly) {
+        printf("%ld\n", matches);
+    }
+    fprintf(stderr, "segments=%d scanned=%ld skipped=%ld records=%ld matches=%ld torn=%ld seconds=%.3f records_per_sec=%.0f\n",
+            segmentCount, scanned, skipped, records, matches, torn, seconds, seconds > 0 ? records / seconds : 0.0);
+    for (int s = 0; s < segmentCount; s++) {
+        free(names[s]);
+    }
+    return 0;
+}
@@ -6,8 +6,9 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <unistd.h>
 
-// Define the port number for UDP communication
+// Define the default port number for UDP communication (can be changed with -p)
 #define PORT 8081
 
 // Protocol Primitives
@@ -22,6 +23,7 @@
 #define NOT_PAID 0XFFF9       // Subscriber has not paid
 #define NOT_EXIST 0XFFFA      // Subscriber does not exist
 #define ACCESS_OK 0XFFFB      // Access granted
+#define COOKIE_CHALLENGE 0XFFFC // Server is under load: resend the request with the returned cookie
 
 // Supported Technology Types
 #define TECH_2G 2             // 2G technology
@@ -43,6 +45,7 @@ typedef struct permissionPacket {
     uint8_t tech;          // Technology type (2G, 3G, 4G, 5G)
     unsigned long src_sub_no;  // Subscriber number
     uint16_t pk_end_id;    // Packet end identifier
+    uint32_t cookie;       // Cookie echoed from the last COOKIE_CHALLENGE, 0 if none
 } PermissionPacket;
 
 // Initialize a permission request packet with default header values.
@@ -54,6 +57,7 @@ PermissionPacket initializingPermissionPacket() {
     permissionPacket.cid = CL_ID;
     permissionPacket.permission = ACCESS_PERM;
     permissionPacket.pk_end_id = PK_END_ID;
+    permissionPacket.cookie = 0;
     return permissionPacket;
 }
 
@@ -70,7 +74,7 @@ void displayPermissionPacket(PermissionPacket permissionPacket) {
     printf("End Packet ID: %x\n", permissionPacket.pk_end_id);
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     PermissionPacket permissionRequestPacket;
     PermissionPacket returnedPacket;
 
@@ -82,6 +86,19 @@ int main() {
     int time_temp = 0;
     int seqNo = 0;
     int resendCt = 0;
+    int challengeCt = 0;
+    int port = PORT;
+    int option;
+
+    // -p PORT sends to a different port, e.g. the impairment proxy in ../Tools.
+    while ((option = getopt(argc, argv, "p:")) != -1) {
+        if (option == 'p') {
+            port = atoi(optarg);
+        } else {
+            printf("Usage: %s [-p port]\n", argv[0]);
+            exit(1);
+        }
+    }
 
     // Create a UDP socket and check for errors.
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
@@ -93,7 +110,7 @@ int main() {
     bzero(&clAddress, sizeof(clAddress));
     clAddress.sin_family = AF_INET;
     clAddress.sin_addr.s_addr = INADDR_ANY;
-    clAddress.sin_port = htons(PORT);
+    clAddress.sin_port = htons(port);
     clAddrLen = sizeof(clAddress);
 
     // Set a receive timeout of 3 seconds on the socket to handle delayed responses.
@@ -115,6 +132,7 @@ int main() {
     for (int i = 0; i < 5; i++) {
         seqNo++;         // Increment packet sequence number.
         resendCt = 0;    // Reset retransmission counter.
+        challengeCt = 0; // Reset cookie challenge counter.
         time_temp = 0;   // Reset timer variable.
         char *cliInfoParts;
 
@@ -153,6 +171,13 @@ int main() {
                 printf("\nERROR - NO ACK RECEIVED FROM SERVER.\n");
                 printf("RE-TRANSMITTING THE PACKET.\n");
                 resendCt++;
+            } else if (returnedPacket.permission == COOKIE_CHALLENGE && challengeCt < MAX_TRIES) {
+                // The server is under load and wants proof that we receive its packets.
+                // The cookie stays valid for later requests, so it is kept in the packet.
+                printf("\nINFO - SERVER IS UNDER LOAD, RESENDING WITH ITS COOKIE.\n");
+                permissionRequestPacket.cookie = returnedPacket.cookie;
+                challengeCt++;
+                time_temp = 0;
             } else if (returnedPacket.permission == NOT_PAID) {
                 printf("\nINFO - SUBSCRIBER %lu HAS NOT PAID FOR THE SERVICE.\n", permissionRequestPacket.src_sub_no);
             } else if (returnedPacket.permission == NOT_EXIST) {
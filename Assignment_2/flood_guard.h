@@ -0,0 +1,299 @@
+// -----------------------------------------------------------------------------
+// Flood Protection for the Authentication Server
+// -----------------------------------------------------------------------------
+//
+// Token-bucket rate limiters and a stateless cookie challenge:
+//
+// - Per source address and per subscriber number, each bucket refills at a fixed
+//   rate (tokens per second) up to a burst size. Refill is computed lazily from a
+//   coarse millisecond clock when a bucket is used, so idle buckets cost nothing.
+//   Buckets live in a fixed-size open-addressing table; key and state are updated
+//   with compare-and-swap, so the table needs no lock. Keys that cannot find a
+//   slot within a few probes share one overflow bucket, which caps a flood from
+//   many (spoofed) addresses as a whole.
+//
+// - Above a configurable request rate, a request must carry a cookie: a SipHash
+//   of the source address and port under a secret key and the current epoch. A
+//   request without a valid cookie only gets a COOKIE_CHALLENGE packet, the same
+//   size as the request, so a spoofed source never receives a lookup answer and the
+//   server cannot be used to amplify traffic.
+//
+// - A request with a valid cookie has proven its address and port, so it is
+//   charged to a bucket of its own (keyed by address and port) instead of the
+//   source address bucket. Spoofed requests forging a client's address can empty
+//   the address bucket, but not the bucket the client's cookied requests use.
+
+#ifndef FLOOD_GUARD_H
+#define FLOOD_GUARD_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GUARD_TABLE_SLOTS 65536       // Buckets per table (power of two).
+#define GUARD_MAX_PROBES 16           // Slots tried before falling back to the overflow bucket.
+#define GUARD_STALE_MS 10000          // A full bucket unused this long may be taken over by another key.
+#define GUARD_LOAD_WINDOW_MS 100      // Window used to measure the request rate.
+#define GUARD_COOKIE_EPOCH_MS 30000   // Cookies stay valid for one to two epochs.
+#define GUARD_TOKEN 1000              // One request, in milli-tokens.
+
+// One bucket. state packs the time of the last refill (ms, high 32 bits) and the milli-tokens left (low 32 bits).
+typedef struct TokenBucketSlot {
+    _Atomic uint64_t key;             // Key + 1, or 0 while the slot is empty.
+    _Atomic uint64_t state;
+} TokenBucketSlot;
+
+typedef struct TokenTable {
+    TokenBucketSlot *slots;
+    uint32_t rate;                    // Tokens per second; also milli-tokens per millisecond. 0 disables the table.
+    uint32_t burst;                   // Bucket size in milli-tokens.
+    TokenBucketSlot overflow;         // Shared by keys that found no slot.
+} TokenTable;
+
+typedef struct FloodGuard {
+    TokenTable sources;               // Keyed by IPv4 source address.
+    TokenTable subscribers;           // Keyed by subscriber number.
+    TokenTable clients;               // Keyed by address and port, for requests with a valid cookie.
+    uint64_t cookieKey[2];            // Secret SipHash key, chosen at startup.
+    uint32_t cookieThreshold;         // Requests per second above which cookies are required, 0 = never.
+    _Atomic uint32_t windowStart;     // Start of the current load window (ms).
+    _Atomic uint32_t windowCount;     // Requests seen in the current window.
+    _Atomic uint32_t currentRate;     // Requests per second measured over the last full window.
+    _Atomic long sourceDrops;         // Requests dropped by the per-source limiter.
+    _Atomic long subscriberDrops;     // Requests dropped by the per-subscriber limiter.
+    _Atomic long challenges;          // Cookie challenges sent.
+} FloodGuard;
+
+// Outcome of floodGuardCheck().
+#define GUARD_ALLOW 0                 // Process the request.
+#define GUARD_DROP 1                  // Send nothing.
+#define GUARD_CHALLENGE 2             // Send a COOKIE_CHALLENGE carrying *challengeCookie.
+
+// Coarse monotonic clock in milliseconds. Differences are taken as signed 32-bit values, so wrap-around is harmless.
+static inline uint32_t guardNowMs(void) {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static inline uint64_t guardMix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+#define GUARD_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define GUARD_SIPROUND(v0, v1, v2, v3) do { \
+    v0 += v1; v1 = GUARD_ROTL(v1, 13); v1 ^= v0; v0 = GUARD_ROTL(v0, 32); \
+    v2 += v3; v3 = GUARD_ROTL(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = GUARD_ROTL(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = GUARD_ROTL(v1, 17); v1 ^= v2; v2 = GUARD_ROTL(v2, 32); \
+} while (0)
+
+// SipHash-2-4 over whole 64-bit words.
+static inline uint64_t guardSipHash(const uint64_t key[2], const uint64_t *words, int count) {
+    uint64_t v0 = key[0] ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = key[1] ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = key[0] ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = key[1] ^ 0x7465646279746573ULL;
+    for (int i = 0; i < count; i++) {
+        v3 ^= words[i];
+        GUARD_SIPROUND(v0, v1, v2, v3);
+        GUARD_SIPROUND(v0, v1, v2, v3);
+        v0 ^= words[i];
+    }
+    uint64_t last = (uint64_t)(count * 8) << 56;
+    v3 ^= last;
+    GUARD_SIPROUND(v0, v1, v2, v3);
+    GUARD_SIPROUND(v0, v1, v2, v3);
+    v0 ^= last;
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; i++) {
+        GUARD_SIPROUND(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// Take one token from a bucket, refilling it first. Returns 1 if a token was available.
+static inline int tokenBucketTake(TokenTable *table, TokenBucketSlot *slot, uint32_t nowMs) {
+    uint64_t state = atomic_load_explicit(&slot->state, memory_order_relaxed);
+    while (1) {
+        // Another thread may already have stored a later time; that counts as no time passed.
+        int32_t elapsed = (int32_t)(nowMs - (uint32_t)(state >> 32));
+        if (elapsed < 0) {
+            elapsed = 0;
+        }
+        uint64_t tokens = (uint32_t)state + (uint64_t)elapsed * table->rate;
+        if (tokens > table->burst) {
+            tokens = table->burst;
+        }
+        int allowed = tokens >= GUARD_TOKEN;
+        if (allowed) {
+            tokens -= GUARD_TOKEN;
+        }
+        // Keep the later time, so the bucket's clock never moves backwards.
+        uint64_t next = (elapsed > 0 ? (uint64_t)nowMs << 32 : state & 0xFFFFFFFF00000000ULL) | tokens;
+        if (atomic_compare_exchange_weak_explicit(&slot->state, &state, next,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            return allowed;
+        }
+    }
+}
+
+// Charge one request to the bucket of key. Returns 1 if the request is within its rate.
+static inline int tokenTableAllow(TokenTable *table, uint64_t key, uint32_t nowMs) {
+    if (table->rate == 0) {
+        return 1;
+    }
+    uint64_t stored = key + 1;
+    uint64_t fullState = ((uint64_t)nowMs << 32) | table->burst;
+    uint32_t home = (uint32_t)guardMix(key) & (GUARD_TABLE_SLOTS - 1);
+
+    for (int probe = 0; probe < GUARD_MAX_PROBES; probe++) {
+        TokenBucketSlot *slot = &table->slots[(home + probe) & (GUARD_TABLE_SLOTS - 1)];
+        uint64_t current = atomic_load_explicit(&slot->key, memory_order_acquire);
+        if (current == stored) {
+            return tokenBucketTake(table, slot, nowMs);
+        }
+        if (current == 0) {
+            if (atomic_compare_exchange_strong(&slot->key, &current, stored)) {
+                atomic_store_explicit(&slot->state, fullState, memory_order_relaxed);
+                return tokenBucketTake(table, slot, nowMs);
+            }
+            if (current == stored) {
+                return tokenBucketTake(table, slot, nowMs);
+            }
+            continue;
+        }
+
+        // Take over a slot whose owner has been quiet long enough to have a full bucket again.
+        uint64_t state = atomic_load_explicit(&slot->state, memory_order_relaxed);
+        if ((int32_t)(nowMs - (uint32_t)(state >> 32)) > GUARD_STALE_MS &&
+            atomic_compare_exchange_strong(&slot->key, &current, stored)) {
+            atomic_store_explicit(&slot->state, fullState, memory_order_relaxed);
+            return tokenBucketTake(table, slot, nowMs);
+        }
+    }
+    return tokenBucketTake(table, &table->overflow, nowMs);
+}
+
+static inline int tokenTableInit(TokenTable *table, uint32_t rate) {
+    memset(table, 0, sizeof(*table));
+    table->rate = rate;
+    table->burst = (rate > 0 ? rate : 1) * GUARD_TOKEN;
+    if (rate == 0) {
+        return 0;
+    }
+    table->slots = calloc(GUARD_TABLE_SLOTS, sizeof(TokenBucketSlot));
+    if (table->slots == NULL) {
+        return -1;
+    }
+    atomic_store(&table->overflow.state, ((uint64_t)guardNowMs() << 32) | table->burst);
+    return 0;
+}
+
+// Set up the guard. A rate or threshold of 0 turns that protection off.
+static inline int floodGuardInit(FloodGuard *guard, uint32_t sourceRate, uint32_t subscriberRate, uint32_t cookieThreshold) {
+    memset(guard, 0, sizeof(*guard));
+    if (tokenTableInit(&guard->sources, sourceRate) < 0 || tokenTableInit(&guard->subscribers, subscriberRate) < 0 ||
+        tokenTableInit(&guard->clients, sourceRate) < 0) {
+        return -1;
+    }
+    guard->cookieThreshold = cookieThreshold;
+
+    // Secret cookie key from the system's random source, or a time/pid mix if it is unavailable.
+    FILE *randomFile = fopen("/dev/urandom", "rb");
+    if (randomFile == NULL || fread(guard->cookieKey, sizeof(guard->cookieKey), 1, randomFile) != 1) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        guard->cookieKey[0] = guardMix((uint64_t)ts.tv_nsec ^ ((uint64_t)getpid() << 32));
+        guard->cookieKey[1] = guardMix((uint64_t)ts.tv_sec ^ guard->cookieKey[0]);
+    }
+    if (randomFile != NULL) {
+        fclose(randomFile);
+    }
+    atomic_store(&guard->windowStart, guardNowMs());
+    return 0;
+}
+
+static inline void floodGuardFree(FloodGuard *guard) {
+    free(guard->sources.slots);
+    free(guard->subscribers.slots);
+    free(guard->clients.slots);
+}
+
+// Cookie for a source address and port in the given epoch. Never 0, which means "no cookie".
+static inline uint32_t floodGuardCookie(FloodGuard *guard, uint32_t address, uint16_t port, uint32_t epoch) {
+    uint64_t words[2] = {((uint64_t)address << 16) | port, epoch};
+    uint32_t cookie = (uint32_t)guardSipHash(guard->cookieKey, words, 2);
+    return cookie != 0 ? cookie : 1;
+}
+
+// Count a request towards the measured load and report whether cookies are currently required.
+static inline int floodGuardUnderLoad(FloodGuard *guard, uint32_t nowMs) {
+    if (guard->cookieThreshold == 0) {
+        return 0;
+    }
+    uint32_t start = atomic_load_explicit(&guard->windowStart, memory_order_relaxed);
+    int32_t elapsed = (int32_t)(nowMs - start);
+    if (elapsed >= GUARD_LOAD_WINDOW_MS &&
+        atomic_compare_exchange_strong(&guard->windowStart, &start, nowMs)) {
+        uint32_t count = atomic_exchange(&guard->windowCount, 0);
+        atomic_store(&guard->currentRate, (uint32_t)((uint64_t)count * 1000 / elapsed));
+    }
+    atomic_fetch_add_explicit(&guard->windowCount, 1, memory_order_relaxed);
+    return atomic_load_explicit(&guard->currentRate, memory_order_relaxed) > guard->cookieThreshold;
+}
+
+// Decide what to do with a request. address and port are in network byte order.
+// For GUARD_CHALLENGE, *challengeCookie is the cookie the client must echo.
+static inline int floodGuardCheck(FloodGuard *guard, uint32_t address, uint16_t port,
+                                  unsigned long subscriber, uint32_t cookie, uint32_t *challengeCookie) {
+    uint32_t nowMs = guardNowMs();
+    int underLoad = floodGuardUnderLoad(guard, nowMs);
+
+    // The cookie is checked first, so spoofed requests from the same address cannot use up
+    // the rate of a client that has proven it receives our packets.
+    uint32_t epoch = nowMs / GUARD_COOKIE_EPOCH_MS;
+    uint32_t expected = floodGuardCookie(guard, address, port, epoch);
+    int cookieValid = cookie != 0 && (cookie == expected || cookie == floodGuardCookie(guard, address, port, epoch - 1));
+
+    if (cookieValid) {
+        if (!tokenTableAllow(&guard->clients, ((uint64_t)address << 16) | port, nowMs)) {
+            atomic_fetch_add_explicit(&guard->sourceDrops, 1, memory_order_relaxed);
+            return GUARD_DROP;
+        }
+    } else {
+        // Per-source limit before the challenge, which also caps the challenges reflected to a spoofed address.
+        if (!tokenTableAllow(&guard->sources, address, nowMs)) {
+            atomic_fetch_add_explicit(&guard->sourceDrops, 1, memory_order_relaxed);
+            return GUARD_DROP;
+        }
+
+        // Under load, only sources that have proven they receive our packets are served.
+        if (underLoad) {
+            *challengeCookie = expected;
+            atomic_fetch_add_explicit(&guard->challenges, 1, memory_order_relaxed);
+            return GUARD_CHALLENGE;
+        }
+    }
+
+    if (!tokenTableAllow(&guard->subscribers, subscriber, nowMs)) {
+        atomic_fetch_add_explicit(&guard->subscriberDrops, 1, memory_order_relaxed);
+        return GUARD_DROP;
+    }
+    return GUARD_ALLOW;
+}
+
+#endif
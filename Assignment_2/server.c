@@ -6,10 +6,33 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
 
-// Define the UDP port on which the server will listen.
+// Optional io_uring receive/send engine, selected with -e.
+#include "../Common/udp_uring.h"
+
+// Per-source/per-subscriber rate limiting and the cookie challenge, enabled with -s, -u and -c.
+#include "flood_guard.h"
+
+// Optional capture of every received datagram to a trace file, enabled with -w.
+#include "../Common/udp_trace.h"
+
+// Optional compressed subscriber table used instead of the plain array, enabled with -z.
+#include "subscriber_store.h"
+
+// Optional durable log of every decision, enabled with -a (needs -pthread).
+#include "audit_log.h"
+
+// Optional sampled per-packet latency tracing with kernel timestamps, enabled with -l.
+#include "../Common/latency_trace.h"
+
+// Define the default UDP port on which the server will listen (can be changed with -p).
 #define PORT 8081
 
+// Default for -n: trace the latency of one packet in this many.
+#define LATENCY_SAMPLE_EVERY 1000
+
 // Total number of subscribers maintained in the verification database.
 #define NUM_OF_SUBS 10
 
@@ -18,6 +41,7 @@
 #define NOT_PAID 0XFFF9       // Code indicating the subscriber has not paid.
 #define NOT_EXIST 0XFFFA      // Code indicating the subscriber does not exist.
 #define ACCESS_OK 0XFFFB      // Code indicating that access is granted.
+#define COOKIE_CHALLENGE 0XFFFC // Code asking the client to resend the request with the given cookie.
 
 // Structure representing the permission packet exchanged between client and server.
 typedef struct permissionPacket {
@@ -29,6 +53,7 @@ typedef struct permissionPacket {
     uint8_t technology;               // Technology type (e.g., 2G, 3G, etc.).
     unsigned long src_sub_no;         // Subscriber number.
     uint16_t end_packet_identifier;   // Identifier marking the end of the packet.
+    uint32_t cookie;                  // Cookie from a COOKIE_CHALLENGE, or 0 (fits in the former padding).
 } PermissionPacket;
 
 // Structure for storing server-side subscriber data.
@@ -49,6 +74,7 @@ PermissionPacket initializingPermissionPacket(PermissionPacket receivedPacket) {
     sendPacket.technology = receivedPacket.technology;
     sendPacket.src_sub_no = receivedPacket.src_sub_no;
     sendPacket.end_packet_identifier = receivedPacket.end_packet_identifier;
+    sendPacket.cookie = receivedPacket.cookie;
     return sendPacket;
 }
 
@@ -88,6 +114,52 @@ int verifyUser(ServerData serverData[], unsigned long src_sub_no, uint8_t techno
     return verify;
 }
 
+// A subscriber entry and its position in the data file, for building the compressed store.
+typedef struct SortedServerData {
+    ServerData entry;
+    int index;
+} SortedServerData;
+
+// Order subscribers by number, and entries with the same number by their position in the file,
+// so the store finds the same first match as verifyUser().
+int compareServerData(const void *a, const void *b) {
+    const SortedServerData *left = a;
+    const SortedServerData *right = b;
+    if (left->entry.sub_info != right->entry.sub_info) {
+        return (left->entry.sub_info > right->entry.sub_info) - (left->entry.sub_info < right->entry.sub_info);
+    }
+    return left->index - right->index;
+}
+
+// Build the compressed subscriber store from the loaded subscriber data.
+// Returns 0 on success, or -1 if an entry cannot be stored (e.g. a technology code above 7).
+int buildSubscriberStore(SubscriberStore *store, ServerData serverData[], int count) {
+    SortedServerData sorted[NUM_OF_SUBS];
+    unsigned long maxNumber = 0;
+    for (int i = 0; i < count; i++) {
+        sorted[i].entry = serverData[i];
+        sorted[i].index = i;
+        if (serverData[i].sub_info > maxNumber) {
+            maxNumber = serverData[i].sub_info;
+        }
+    }
+    qsort(sorted, count, sizeof(SortedServerData), compareServerData);
+    if (subscriberStoreBegin(store, count, maxNumber) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (subscriberStoreAdd(store, sorted[i].entry.sub_info, sorted[i].entry.technology, sorted[i].entry.status) < 0) {
+            subscriberStoreFree(store);
+            return -1;
+        }
+    }
+    if (subscriberStoreFinish(store) < 0) {
+        subscriberStoreFree(store);
+        return -1;
+    }
+    return 0;
+}
+
 // Display the contents of a permission packet to the console for debugging purposes.
 void displayPermissionPacket(PermissionPacket permissionPacket) {
     printf("\n\n");
@@ -101,15 +173,246 @@ void displayPermissionPacket(PermissionPacket permissionPacket) {
     printf("End Packet ID: %x\n", permissionPacket.end_packet_identifier);
 }
 
-int main() {
+// Everything the packet handler needs besides the packet itself.
+typedef struct ServerContext {
+    ServerData *serverData;  // Subscriber table loaded from the verification database.
+    int quiet;               // Set by -q: do not print every packet.
+    FloodGuard *guard;       // Rate limiter and cookie check, or NULL when -s, -u and -c are all off.
+    TraceWriter *trace;      // Capture file given with -w, or NULL.
+    SubscriberStore *store;  // Compressed subscriber table used instead of serverData (-z), or NULL.
+    AuditLog *audit;         // Audit log directory given with -a, or NULL.
+} ServerContext;
+
+// Set by SIGINT/SIGTERM so the receive loops can stop and print their statistics.
+static volatile sig_atomic_t stopRequested = 0;
+
+void requestStop(int signo) {
+    (void)signo;
+    stopRequested = 1;
+}
+
+// Check a received packet from the given source and build the response.
+// Returns 1 if the response should be sent back, or 0 if the packet is not an access permission request
+// or was dropped by the rate limiter.
+int handlePermissionPacket(ServerContext *context, PermissionPacket *receivedPacket, PermissionPacket *sendPacket,
+                           const struct sockaddr_in *from) {
+    if (!context->quiet) {
+        displayPermissionPacket(*receivedPacket);
+        printf("\n\n");
+    }
+    if (receivedPacket->permission != ACCESS_PERM) {
+        return 0;
+    }
+
+    // Initialize the response packet based on the received packet.
+    *sendPacket = initializingPermissionPacket(*receivedPacket);
+
+    // Rate limits and, under load, the cookie check come before the database lookup.
+    if (context->guard != NULL) {
+        uint32_t challengeCookie = 0;
+        int decision = floodGuardCheck(context->guard, from->sin_addr.s_addr, from->sin_port,
+                                       receivedPacket->src_sub_no, receivedPacket->cookie, &challengeCookie);
+        if (decision == GUARD_DROP) {
+            return 0;
+        }
+        if (decision == GUARD_CHALLENGE) {
+            sendPacket->permission = COOKIE_CHALLENGE;
+            sendPacket->cookie = challengeCookie;
+            return 1;
+        }
+    }
+
+    // Verify the subscriber's details against the server data.
+    latencyStamp(LATENCY_LOOKUP_START);
+    int verify = context->store != NULL
+                     ? subscriberStoreLookup(context->store, receivedPacket->src_sub_no, receivedPacket->technology)
+                     : verifyUser(context->serverData, receivedPacket->src_sub_no, receivedPacket->technology);
+    latencyStamp(LATENCY_LOOKUP_END);
+    if (verify == -1) {
+        sendPacket->permission = NOT_EXIST; // Subscriber not found.
+    } else if (verify == 0) {
+        sendPacket->permission = NOT_PAID;  // Subscriber exists but has not paid.
+    } else if (verify == 1) {
+        sendPacket->permission = ACCESS_OK; // Subscriber exists and has paid.
+    }
+
+    // Record the decision; the audit writer thread makes it durable in the background.
+    if (context->audit != NULL) {
+        auditLogRecord(context->audit, receivedPacket->src_sub_no, receivedPacket->technology, sendPacket->permission,
+                       from->sin_addr.s_addr, from->sin_port);
+    }
+    return 1;
+}
+
+// Called by the io_uring engine for every received datagram.
+void handleUringPacket(UdpUring *ring, void *context, void *packet, int len, struct sockaddr_in *from) {
+    PermissionPacket receivedPacket;
+    PermissionPacket sendPacket;
+    traceWriterAppend(((ServerContext *)context)->trace, packet, len, from);
+    memset(&receivedPacket, 0, sizeof(receivedPacket));
+    memcpy(&receivedPacket, packet, len < (int)sizeof(receivedPacket) ? len : (int)sizeof(receivedPacket));
+    if (handlePermissionPacket((ServerContext *)context, &receivedPacket, &sendPacket, from)) {
+        udpUringSend(ring, &sendPacket, sizeof(PermissionPacket), from, 0);
+    }
+}
+
+// Print what the flood guard dropped or challenged, and free its tables.
+void closeGuard(ServerContext *context) {
+    if (context->guard != NULL) {
+        printf("Source drops: %ld  Subscriber drops: %ld  Cookie challenges: %ld\n",
+               atomic_load(&context->guard->sourceDrops), atomic_load(&context->guard->subscriberDrops),
+               atomic_load(&context->guard->challenges));
+        floodGuardFree(context->guard);
+        context->guard = NULL;
+    }
+}
+
+// Finish the capture file, if one is being written.
+void closeCapture(ServerContext *context) {
+    if (context->trace != NULL) {
+        printf("Captured: %ld packets\n", context->trace->records);
+        traceWriterClose(context->trace);
+        context->trace = NULL;
+    }
+}
+
+// Free the compressed subscriber table, if one was built.
+void closeStore(ServerContext *context) {
+    if (context->store != NULL) {
+        subscriberStoreFree(context->store);
+        context->store = NULL;
+    }
+}
+
+// Flush and close the audit log, if one is being written.
+void closeAudit(ServerContext *context) {
+    if (context->audit != NULL) {
+        auditLogClose(context->audit);
+        printf("Audit: %ld records  %ld segments  %ld fdatasync calls  %ld stalls  %ld errors  %ld lost\n",
+               atomic_load(&context->audit->records), atomic_load(&context->audit->segments),
+               atomic_load(&context->audit->syncs), atomic_load(&context->audit->stalls),
+               atomic_load(&context->audit->errors), atomic_load(&context->audit->lost));
+        context->audit = NULL;
+    }
+}
+
+// ../Tools/trace_replay.c includes this file with SERVER_NO_MAIN defined to call handlePermissionPacket() directly.
+#ifndef SERVER_NO_MAIN
+int main(int argc, char *argv[]) {
     PermissionPacket sendPacket;
     PermissionPacket receivedPacket;
     ServerData serverData[NUM_OF_SUBS];
+    ServerContext context = {serverData, 0, NULL, NULL, NULL, NULL};
+    AuditLog audit;
+    const char *auditDirectory = NULL;
+    double durabilityMs = 10, segmentMb = 64, segmentSeconds = 3600;
+    SubscriberStore store;
+    int useStore = 0;
+    FloodGuard guard;
+    TraceWriter trace;
+    const char *capturePath = NULL;
+    unsigned sourceRate = 0, subscriberRate = 0, cookieThreshold = 0;
+    const char *latencyPath = NULL;
+    unsigned sampleEvery = LATENCY_SAMPLE_EVERY;
+    LatencyTracer tracer;
 
     int sockfd;
     struct sockaddr_in serverAddress;
     socklen_t serverAddrLen;
     int time_temp = 0; 
+    int port = PORT;
+    const char *engine = "classic";
+    int option;
+
+    // Counters printed when the server is stopped.
+    long packetsReceived = 0;
+    long syscalls = 0;
+
+    // -p PORT listens on a different port, e.g. behind the impairment proxy in ../Tools.
+    // -e ENGINE selects the I/O backend: classic (recvfrom/sendto), uring, or uring-sqpoll.
+    // -q stops printing every packet, for load tests.
+    // -s RATE and -u RATE limit requests per second from one source address and for one subscriber.
+    // -c RATE requires a cookie from every client while the server receives more than RATE requests per second.
+    // -w FILE records every received datagram to FILE for ../Tools/trace_replay.
+    // -z looks subscribers up in the compressed store (subscriber_store.h) instead of the plain array.
+    // -a DIR records every decision in an audit log in DIR; -d MS is the longest a decision may wait for
+    // fdatasync(), and -r MB / -t SECONDS start a new segment after that size or age.
+    // -l FILE traces the latency of sampled packets and writes them to FILE as Chrome trace JSON on exit;
+    // -n N traces one packet in N (default 1000).
+    while ((option = getopt(argc, argv, "p:e:qs:u:c:w:za:d:r:t:l:n:")) != -1) {
+        if (option == 'p') {
+            port = atoi(optarg);
+        } else if (option == 'e') {
+            engine = optarg;
+        } else if (option == 'q') {
+            context.quiet = 1;
+        } else if (option == 's') {
+            sourceRate = (unsigned)atoi(optarg);
+        } else if (option == 'u') {
+            subscriberRate = (unsigned)atoi(optarg);
+        } else if (option == 'c') {
+            cookieThreshold = (unsigned)atoi(optarg);
+        } else if (option == 'w') {
+            capturePath = optarg;
+        } else if (option == 'z') {
+            useStore = 1;
+        } else if (option == 'a') {
+            auditDirectory = optarg;
+        } else if (option == 'd') {
+            durabilityMs = atof(optarg);
+        } else if (option == 'r') {
+            segmentMb = atof(optarg);
+        } else if (option == 't') {
+            segmentSeconds = atof(optarg);
+        } else if (option == 'l') {
+            latencyPath = optarg;
+        } else if (option == 'n') {
+            if (atoi(optarg) < 1) {
+                printf("\nERROR - -n NEEDS TO TRACE ONE PACKET IN AT LEAST 1.\n");
+                exit(1);
+            }
+            sampleEvery = (unsigned)atoi(optarg);
+        } else {
+            printf("Usage: %s [-p port] [-e classic|uring|uring-sqpoll] [-q] [-s rate] [-u rate] [-c rate] [-w capture_file] [-z]\n"
+                   "          [-a audit_dir] [-d durability_ms] [-r segment_mb] [-t segment_seconds]\n"
+                   "          [-l latency_file] [-n sample_every]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if (sourceRate > 0 || subscriberRate > 0 || cookieThreshold > 0) {
+        if (floodGuardInit(&guard, sourceRate, subscriberRate, cookieThreshold) < 0) {
+            printf("\nERROR - COULD NOT ALLOCATE THE RATE LIMITER.\n");
+            exit(1);
+        }
+        context.guard = &guard;
+    }
+
+    // Open the capture file before any packet can arrive.
+    if (capturePath != NULL) {
+        if (traceWriterOpen(&trace, capturePath) < 0) {
+            printf("\nERROR - THE CAPTURE FILE %s COULD NOT BE CREATED.\n", capturePath);
+            exit(1);
+        }
+        context.trace = &trace;
+    }
+
+    // Start the audit writer thread.
+    if (auditDirectory != NULL) {
+        if (auditLogOpen(&audit, auditDirectory, durabilityMs, segmentMb, segmentSeconds) < 0) {
+            printf("\nERROR - THE AUDIT LOG IN %s COULD NOT BE OPENED.\n", auditDirectory);
+            exit(1);
+        }
+        context.audit = &audit;
+    }
+
+    // Stop cleanly on Ctrl-C so the statistics can be printed.
+    // SA_RESTART is left out so a blocking recvfrom() returns when the signal arrives.
+    struct sigaction stopAction;
+    memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = requestStop;
+    sigaction(SIGINT, &stopAction, NULL);
+    sigaction(SIGTERM, &stopAction, NULL);
 
     // Create a UDP socket for the server.
     sockfd = socket(AF_INET, SOCK_DGRAM, 0); 
@@ -121,7 +424,7 @@ int main() {
     bzero(&serverAddress, sizeof(serverAddress));
     serverAddress.sin_family = AF_INET;
     serverAddress.sin_addr.s_addr = INADDR_ANY;
-    serverAddress.sin_port = htons(PORT);
+    serverAddress.sin_port = htons(port);
     serverAddrLen = sizeof(serverAddress);
 
     // Bind the socket to the server address and port.
@@ -129,32 +432,83 @@ int main() {
 
     // Load the subscriber data from the verification database file.
     getServerData(serverData);
+    if (useStore) {
+        if (buildSubscriberStore(&store, serverData, NUM_OF_SUBS) < 0) {
+            printf("\nERROR - THE SUBSCRIBER DATA COULD NOT BE COMPRESSED, USING THE PLAIN TABLE.\n");
+        } else {
+            context.store = &store;
+        }
+    }
 
-    // Continuously listen for incoming packets from clients.
-    while (1) {
-        // Receive a packet from a client.
-        time_temp = recvfrom(sockfd, &receivedPacket, sizeof(PermissionPacket), 0, (struct sockaddr *)&serverAddress, &serverAddrLen);
-        displayPermissionPacket(receivedPacket);
-
-        // If a valid packet is received and it is an access permission request, process it.
-        if ((time_temp >= 0) && (receivedPacket.permission == ACCESS_PERM)) { 
-            // Initialize the response packet based on the received packet.
-            sendPacket = initializingPermissionPacket(receivedPacket);
-            
-            // Verify the subscriber's details against the server data.
-            int verify = verifyUser(serverData, receivedPacket.src_sub_no, receivedPacket.technology);
-            if (verify == -1) {
-                sendPacket.permission = NOT_EXIST; // Subscriber not found.
-            } else if (verify == 0) {
-                sendPacket.permission = NOT_PAID;  // Subscriber exists but has not paid.
-            } else if (verify == 1) {
-                sendPacket.permission = ACCESS_OK; // Subscriber exists and has paid.
+    // io_uring backend: runs until stopped, or falls back to the classic loop if unavailable.
+    if (strcmp(engine, "uring") == 0 || strcmp(engine, "uring-sqpoll") == 0) {
+        UdpUring ring;
+        if (latencyPath != NULL) {
+            printf("\nINFO - LATENCY TRACING IS ONLY USED WITH THE CLASSIC ENGINE.\n");
+        }
+        if (udpUringInit(&ring, sockfd, strcmp(engine, "uring-sqpoll") == 0) == 0) {
+            if (udpUringRun(&ring, handleUringPacket, &context, &stopRequested) < 0) {
+                printf("\nERROR - THE IO_URING ENGINE FAILED.\n");
             }
-            // Send the response packet back to the client.
-            sendto(sockfd, &sendPacket, sizeof(PermissionPacket), 0, (struct sockaddr *) &serverAddress, serverAddrLen);
+            printf("\nEngine: %s  Packets: %ld  Responses: %ld  Dropped responses: %ld  Syscalls: %ld (%.3f per packet)\n",
+                   engine, ring.packets, ring.responses, ring.sendDrops, ring.syscalls,
+                   ring.packets > 0 ? (double)ring.syscalls / ring.packets : 0.0);
+            closeGuard(&context);
+            closeCapture(&context);
+            closeAudit(&context);
+            closeStore(&context);
+            udpUringClose(&ring);
+            return 0;
         }
-        printf("\n\n");
+        printf("\nINFO - IO_URING IS NOT AVAILABLE, USING THE CLASSIC ENGINE.\n");
+        engine = "classic";
+    } else if (strcmp(engine, "classic") != 0) {
+        printf("\nERROR - UNKNOWN ENGINE %s.\n", engine);
+        exit(1);
+    }
+
+    // Enable kernel timestamps on the socket for latency tracing.
+    if (latencyTracerInit(&tracer, sockfd, latencyPath != NULL ? sampleEvery : 0) < 0) {
+        printf("\nERROR - OUT OF MEMORY FOR THE LATENCY TRACE.\n");
+        exit(1);
+    }
+    if (tracer.enabled && !tracer.kernelTimestamps) {
+        printf("\nINFO - KERNEL TIMESTAMPS ARE NOT AVAILABLE, TRACING USER SPACE STAGES ONLY.\n");
+    }
+
+    // Listen for incoming packets from clients until stopped.
+    while (!stopRequested) {
+        // Receive a packet from a client (with -l, a recvmsg() that also returns the kernel receive timestamp).
+        serverAddrLen = sizeof(serverAddress);
+        time_temp = latencyRecvFrom(&tracer, sockfd, &receivedPacket, sizeof(PermissionPacket), &serverAddress, &serverAddrLen);
+        syscalls++;
+        if (time_temp < 0) {
+            continue;
+        }
+        packetsReceived++;
+        traceWriterAppend(context.trace, &receivedPacket, time_temp, &serverAddress);
+
+        // If it is an access permission request, send the response packet back to the client.
+        latencyStamp(LATENCY_PROCESS_START);
+        int respond = handlePermissionPacket(&context, &receivedPacket, &sendPacket, &serverAddress);
+        latencyStamp(LATENCY_PROCESS_END);
+        if (respond) {
+            latencySendTo(&tracer, sockfd, &sendPacket, sizeof(PermissionPacket), &serverAddress, serverAddrLen);
+            syscalls++;
+        }
+        latencyEndPacket(&tracer, sockfd);
     }
 
+    printf("\nEngine: %s  Packets: %ld  Syscalls: %ld (%.3f per packet)\n", engine, packetsReceived, syscalls,
+           packetsReceived > 0 ? (double)syscalls / packetsReceived : 0.0);
+    closeGuard(&context);
+    closeCapture(&context);
+    closeAudit(&context);
+    closeStore(&context);
+    if (latencyPath != NULL && latencyExport(&tracer, latencyPath) < 0) {
+        printf("\nERROR - THE LATENCY TRACE %s COULD NOT BE WRITTEN.\n", latencyPath);
+    }
+    latencyTracerFree(&tracer);
     return 0;
 }
+#endif
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "subscriber_store.h"
+
+// -----------------------------------------------------------------------------
+// Subscriber Store Benchmark
+// -----------------------------------------------------------------------------
+//
+// Builds a synthetic subscriber table of random 10-digit numbers, once as the plain
+// ServerData array the server uses and once as the compressed SubscriberStore, and
+// compares memory and lookup time. Half of the queries are existing subscribers
+// with their technology, the other half random numbers (nearly all missing).
+//
+// Methods:
+//   linear   - the server's verifyUser() scan (only a few queries, it is O(n))
+//   binary   - binary search over the sorted plain array
+//   store    - subscriberStoreLookup(), one query at a time
+//   batch    - subscriberStoreLookupBatch()
+//
+// Every store answer is checked against the binary search.
+//
+// Compile: gcc -O2 store_bench.c -o store_bench
+// Run:     ./store_bench -n 100000000 -q 10000000
+
+#define MIN_NUMBER 1000000000UL       // Smallest 10-digit subscriber number.
+#define MAX_NUMBER 9999999999UL       // Largest 10-digit subscriber number.
+#define LINEAR_QUERIES 20             // The linear scan is too slow for more at national scale.
+
+// Same layout as ServerData in server.c.
+typedef struct ServerData {
+    unsigned long sub_info;
+    uint8_t technology;
+    int status;
+} ServerData;
+
+static uint64_t benchSeed;
+
+static uint64_t nextRandom(void) {
+    benchSeed = benchSeed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return benchSeed >> 16;
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The server's lookup: scan the whole table.
+static int linearLookup(const ServerData *table, long count, unsigned long number, uint8_t technology) {
+    for (long i = 0; i < count; i++) {
+        if (table[i].sub_info == number && table[i].technology == technology) {
+            return table[i].status;
+        }
+    }
+    return -1;
+}
+
+// First entry with the number, then the entries sharing it.
+static int binaryLookup(const ServerData *table, long count, unsigned long number, uint8_t technology) {
+    long low = 0, high = count;
+    while (low < high) {
+        long middle = low + (high - low) / 2;
+        if (table[middle].sub_info < number) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    for (; low < count && table[low].sub_info == number; low++) {
+        if (table[low].technology == technology) {
+            return table[low].status;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    long count = 100000000;
+    long queries = 10000000;
+    int option;
+    benchSeed = 1;
+
+    while ((option = getopt(argc, argv, "n:q:s:")) != -1) {
+        if (option == 'n') {
+            count = atol(optarg);
+        } else if (option == 'q') {
+            queries = atol(optarg);
+        } else if (option == 's') {
+            benchSeed = strtoull(optarg, NULL, 10);
+        } else {
+            printf("Usage: %s [-n subscribers] [-q queries] [-s seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (count <= 0 || queries <= 0 || (unsigned long)count > (MAX_NUMBER - MIN_NUMBER) / 2) {
+        printf("Usage: %s [-n subscribers] [-q queries] [-s seed]\n", argv[0]);
+        return 1;
+    }
+
+    // Sorted random numbers: gaps averaging the range divided by the count.
+    ServerData *table = malloc(count * sizeof(ServerData));
+    unsigned long *numbers = malloc(queries * sizeof(unsigned long));
+    uint8_t *technologies = malloc(queries);
+    int *results = malloc(queries * sizeof(int));
+    if (table == NULL || numbers == NULL || technologies == NULL || results == NULL) {
+        printf("\nERROR - OUT OF MEMORY.\n");
+        return 1;
+    }
+    unsigned long gap = (MAX_NUMBER - MIN_NUMBER) / count;
+    unsigned long number = MIN_NUMBER;
+    for (long i = 0; i < count; i++) {
+        number += 1 + nextRandom() % (2 * gap - 1);
+        table[i].sub_info = number;
+        table[i].technology = 2 + nextRandom() % 4;
+        table[i].status = nextRandom() % 4 != 0;
+    }
+
+    double start = nowSeconds();
+    SubscriberStore store;
+    if (subscriberStoreBegin(&store, count, table[count - 1].sub_info) < 0) {
+        printf("\nERROR - OUT OF MEMORY.\n");
+        return 1;
+    }
+    for (long i = 0; i < count; i++) {
+        subscriberStoreAdd(&store, table[i].sub_info, table[i].technology, table[i].status);
+    }
+    if (subscriberStoreFinish(&store) < 0) {
+        printf("\nERROR - THE STORE COULD NOT BE BUILT.\n");
+        return 1;
+    }
+    double buildSeconds = nowSeconds() - start;
+
+    for (long i = 0; i < queries; i++) {
+        if (i % 2 == 0) {
+            long index = nextRandom() % count;
+            numbers[i] = table[index].sub_info;
+            technologies[i] = table[index].technology;
+        } else {
+            numbers[i] = MIN_NUMBER + nextRandom() % (MAX_NUMBER - MIN_NUMBER);
+            technologies[i] = 2 + nextRandom() % 4;
+        }
+    }
+
+    size_t plainBytes = count * sizeof(ServerData);
+    size_t storeBytes = subscriberStoreBytes(&store);
+    printf("subscribers=%ld queries=%ld low_bits=%d build_seconds=%.2f\n", count, queries, store.lowBits, buildSeconds);
+    printf("plain_bytes=%zu (%.1f per subscriber)  store_bytes=%zu (%.2f per subscriber, %.1f%% of plain)\n",
+           plainBytes, (double)plainBytes / count, storeBytes, (double)storeBytes / count, 100.0 * storeBytes / plainBytes);
+
+    // Rank/select sanity check.
+    long checkIndex = count / 3;
+    if (subscriberStoreSelect(&store, checkIndex) != table[checkIndex].sub_info ||
+        subscriberStoreRank(&store, table[checkIndex].sub_info) != checkIndex) {
+        printf("\nERROR - RANK/SELECT MISMATCH AT INDEX %ld.\n", checkIndex);
+        return 1;
+    }
+
+    long found = 0;
+    long linearQueries = queries < LINEAR_QUERIES ? queries : LINEAR_QUERIES;
+    start = nowSeconds();
+    for (long i = 0; i < linearQueries; i++) {
+        found += linearLookup(table, count, numbers[i], technologies[i]) >= 0;
+    }
+    printf("%-8s %10.1f ns/lookup  (%ld queries)\n", "linear", (nowSeconds() - start) * 1e9 / linearQueries, linearQueries);
+
+    start = nowSeconds();
+    for (long i = 0; i < queries; i++) {
+        results[i] = binaryLookup(table, count, numbers[i], technologies[i]);
+    }
+    printf("%-8s %10.1f ns/lookup\n", "binary", (nowSeconds() - start) * 1e9 / queries);
+
+    long mismatches = 0;
+    start = nowSeconds();
+    for (long i = 0; i < queries; i++) {
+        int status = subscriberStoreLookup(&store, numbers[i], technologies[i]);
+        mismatches += status != results[i];
+        found += status >= 0;
+    }
+    printf("%-8s %10.1f ns/lookup\n", "store", (nowSeconds() - start) * 1e9 / queries);
+
+    int *batchResults = malloc(queries * sizeof(int));
+    if (batchResults == NULL) {
+        printf("\nERROR - OUT OF MEMORY.\n");
+        return 1;
+    }
+    start = nowSeconds();
+    subscriberStoreLookupBatch(&store, numbers, technologies, queries, batchResults);
+    printf("%-8s %10.1f ns/lookup\n", "batch", (nowSeconds() - start) * 1e9 / queries);
+    for (long i = 0; i < queries; i++) {
+        mismatches += batchResults[i] != results[i];
+    }
+
+    printf("found=%ld mismatches=%ld\n", found, mismatches);
+    subscriberStoreFree(&store);
+    free(batchResults);
+    free(results);
+    free(technologies);
+    free(numbers);
+    free(table);
+    return mismatches != 0;
+}
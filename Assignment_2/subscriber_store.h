@@ -0,0 +1,320 @@
+// -----------------------------------------------------------------------------
+// Compressed Read-Only Subscriber Store
+// -----------------------------------------------------------------------------
+//
+// ServerData takes 16 bytes per subscriber (8-byte number, 1-byte technology and
+// a 4-byte status, plus padding). This store keeps the same information in a few
+// bytes per subscriber:
+//
+// - Subscriber numbers, sorted, are Elias-Fano coded. Each number is split into
+//   lowBits low bits, stored as they are in a packed array, and the remaining high
+//   part, stored in unary in a bit vector: subscriber i sets bit (high + i). Bucket h
+//   (all numbers with high part h) therefore lies between zero number h-1 and zero
+//   number h of that bit vector. With lowBits = log2(range / count) this takes
+//   about 2 + log2(range / count) bits per subscriber.
+//
+// - Technology (3 bits) and paid status (1 bit) share one 4-bit nibble.
+//
+// - Every SUBSCRIBER_SAMPLE-th zero and one of the bit vector is sampled, so
+//   select0/select1 only scan a few words from the nearest sample.
+//
+// 100 million 10-digit subscriber numbers take about 1.65 bytes each (about
+// 165 MB in total) instead of 1.6 GB. A lookup is a sample read, a short
+// popcount scan and a check of the one or two numbers in the bucket.
+//
+// The store is built once, in subscriber number order (subscriberStoreBegin, then
+// subscriberStoreAdd per subscriber, then subscriberStoreFinish), and is read-only
+// after that. Numbers may repeat with different technologies.
+
+#ifndef SUBSCRIBER_STORE_H
+#define SUBSCRIBER_STORE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SUBSCRIBER_SAMPLE 256             // Zeros (and ones) between two select samples.
+#define SUBSCRIBER_MAX_TECHNOLOGY 7       // Largest technology code that fits in 3 bits.
+#define SUBSCRIBER_BATCH 16               // Lookups interleaved by subscriberStoreLookupBatch().
+
+typedef struct SubscriberStore {
+    long count;                           // Subscribers in the store.
+    unsigned long maxNumber;              // Largest subscriber number allowed.
+    int lowBits;                          // Low bits stored explicitly per number.
+    uint64_t *low;                        // count * lowBits bits.
+    uint64_t *high;                       // Unary-coded high parts, highBits bits.
+    uint64_t highBits;
+    uint8_t *attributes;                  // Two nibbles per byte: technology | paid << 3.
+    uint64_t *zeroSamples;                // Position of zero number j * SUBSCRIBER_SAMPLE.
+    uint64_t *oneSamples;                 // Position of one number j * SUBSCRIBER_SAMPLE.
+    long added;                           // Subscribers added so far while building.
+    unsigned long last;                   // Last number added, to enforce the order.
+} SubscriberStore;
+
+// Position of the set bit of the given rank (0-based) in word, which must have more than rank bits set.
+static inline int subscriberSelectInWord(uint64_t word, int rank) {
+    int shift = 0;
+    while (1) {
+        int bits = __builtin_popcountll(word & 0xFF);
+        if (rank < bits) {
+            break;
+        }
+        rank -= bits;
+        word >>= 8;
+        shift += 8;
+    }
+    for (; rank > 0; rank--) {
+        word &= word - 1;
+    }
+    return shift + __builtin_ctzll(word);
+}
+
+static inline uint64_t subscriberLowAt(const SubscriberStore *store, long index) {
+    if (store->lowBits == 0) {
+        return 0;
+    }
+    uint64_t bit = (uint64_t)index * store->lowBits;
+    uint64_t word = bit >> 6;
+    int shift = bit & 63;
+    uint64_t value = store->low[word] >> shift;
+    if (shift + store->lowBits > 64) {
+        value |= store->low[word + 1] << (64 - shift);
+    }
+    return value & ((1ULL << store->lowBits) - 1);
+}
+
+static inline int subscriberAttributesAt(const SubscriberStore *store, long index) {
+    return (store->attributes[index >> 1] >> ((index & 1) * 4)) & 0xF;
+}
+
+// Position of zero number rank in the high bit vector.
+static inline uint64_t subscriberSelect0(const SubscriberStore *store, uint64_t rank) {
+    uint64_t position = store->zeroSamples[rank / SUBSCRIBER_SAMPLE];
+    uint64_t remaining = rank % SUBSCRIBER_SAMPLE;
+    uint64_t word = position >> 6;
+    uint64_t zeros = ~store->high[word] & (~0ULL << (position & 63));
+    while (1) {
+        int bits = __builtin_popcountll(zeros);
+        if (remaining < (uint64_t)bits) {
+            return word * 64 + subscriberSelectInWord(zeros, (int)remaining);
+        }
+        remaining -= bits;
+        zeros = ~store->high[++word];
+    }
+}
+
+// Position of one number rank in the high bit vector.
+static inline uint64_t subscriberSelect1(const SubscriberStore *store, uint64_t rank) {
+    uint64_t position = store->oneSamples[rank / SUBSCRIBER_SAMPLE];
+    uint64_t remaining = rank % SUBSCRIBER_SAMPLE;
+    uint64_t word = position >> 6;
+    uint64_t ones = store->high[word] & (~0ULL << (position & 63));
+    while (1) {
+        int bits = __builtin_popcountll(ones);
+        if (remaining < (uint64_t)bits) {
+            return word * 64 + subscriberSelectInWord(ones, (int)remaining);
+        }
+        remaining -= bits;
+        ones = store->high[++word];
+    }
+}
+
+// (maxNumber + 1) >> shift for 0 < shift < 64, without overflowing when maxNumber is ULONG_MAX.
+static inline uint64_t subscriberUniverseShift(unsigned long maxNumber, int shift) {
+    uint64_t mask = (1ULL << shift) - 1;
+    return ((uint64_t)maxNumber >> shift) + (((uint64_t)maxNumber & mask) == mask);
+}
+
+// Start building a store for count subscribers with numbers up to maxNumber. Returns 0, or -1 if out of memory.
+static inline int subscriberStoreBegin(SubscriberStore *store, long count, unsigned long maxNumber) {
+    memset(store, 0, sizeof(*store));
+    store->count = count;
+    store->maxNumber = maxNumber;
+    while (count > 0 && store->lowBits < 56 && subscriberUniverseShift(maxNumber, store->lowBits + 1) >= (uint64_t)count) {
+        store->lowBits++;
+    }
+    store->highBits = (uint64_t)count + ((uint64_t)maxNumber >> store->lowBits) + 1;
+
+    // One spare word after each bit array lets the readers look one word ahead.
+    store->low = calloc(((uint64_t)count * store->lowBits + 63) / 64 + 1, sizeof(uint64_t));
+    store->high = calloc((store->highBits + 63) / 64 + 1, sizeof(uint64_t));
+    store->attributes = calloc((count + 1) / 2 + 1, 1);
+    if (store->low == NULL || store->high == NULL || store->attributes == NULL) {
+        free(store->low);
+        free(store->high);
+        free(store->attributes);
+        memset(store, 0, sizeof(*store));
+        return -1;
+    }
+    return 0;
+}
+
+// Add the next subscriber. Numbers must not decrease. Returns 0, or -1 if the subscriber cannot be stored.
+static inline int subscriberStoreAdd(SubscriberStore *store, unsigned long number, uint8_t technology, int status) {
+    if (store->added >= store->count || number > store->maxNumber || (store->added > 0 && number < store->last) ||
+        technology > SUBSCRIBER_MAX_TECHNOLOGY || (status != 0 && status != 1)) {
+        return -1;
+    }
+    long index = store->added++;
+    store->last = number;
+
+    if (store->lowBits > 0) {
+        uint64_t low = number & ((1ULL << store->lowBits) - 1);
+        uint64_t bit = (uint64_t)index * store->lowBits;
+        store->low[bit >> 6] |= low << (bit & 63);
+        if ((bit & 63) + store->lowBits > 64) {
+            store->low[(bit >> 6) + 1] |= low >> (64 - (bit & 63));
+        }
+    }
+    uint64_t position = (number >> store->lowBits) + (uint64_t)index;
+    store->high[position >> 6] |= 1ULL << (position & 63);
+    store->attributes[index >> 1] |= (uint8_t)((technology | status << 3) << ((index & 1) * 4));
+    return 0;
+}
+
+// Build the select samples. Returns 0, or -1 if not every subscriber was added or memory ran out.
+static inline int subscriberStoreFinish(SubscriberStore *store) {
+    if (store->added != store->count) {
+        return -1;
+    }
+    uint64_t zeros = store->highBits - store->count;
+    store->zeroSamples = malloc((zeros / SUBSCRIBER_SAMPLE + 1) * sizeof(uint64_t));
+    store->oneSamples = malloc((store->count / SUBSCRIBER_SAMPLE + 1) * sizeof(uint64_t));
+    if (store->zeroSamples == NULL || store->oneSamples == NULL) {
+        return -1;
+    }
+    store->zeroSamples[0] = 0;
+    store->oneSamples[0] = 0;
+
+    // Walk the bit vector a word at a time; a sample point inside a word is found with a select in that word.
+    uint64_t zerosSeen = 0, onesSeen = 0;
+    uint64_t words = (store->highBits + 63) / 64;
+    for (uint64_t word = 0; word < words; word++) {
+        uint64_t ones = store->high[word];
+        uint64_t valid = (word == words - 1 && store->highBits % 64) ? (1ULL << (store->highBits % 64)) - 1 : ~0ULL;
+        uint64_t zeroBits = ~ones & valid;
+        int oneCount = __builtin_popcountll(ones);
+        int zeroCount = __builtin_popcountll(zeroBits);
+        uint64_t next = (zerosSeen + SUBSCRIBER_SAMPLE - 1) / SUBSCRIBER_SAMPLE * SUBSCRIBER_SAMPLE;
+        for (; next < zerosSeen + zeroCount; next += SUBSCRIBER_SAMPLE) {
+            store->zeroSamples[next / SUBSCRIBER_SAMPLE] = word * 64 + subscriberSelectInWord(zeroBits, (int)(next - zerosSeen));
+        }
+        next = (onesSeen + SUBSCRIBER_SAMPLE - 1) / SUBSCRIBER_SAMPLE * SUBSCRIBER_SAMPLE;
+        for (; next < onesSeen + oneCount; next += SUBSCRIBER_SAMPLE) {
+            store->oneSamples[next / SUBSCRIBER_SAMPLE] = word * 64 + subscriberSelectInWord(ones, (int)(next - onesSeen));
+        }
+        zerosSeen += zeroCount;
+        onesSeen += oneCount;
+    }
+    return 0;
+}
+
+// Index of the first subscriber whose number has the given high part.
+static inline long subscriberBucketStart(const SubscriberStore *store, uint64_t bucket) {
+    if (bucket == 0) {
+        return 0;
+    }
+    // The bucket starts right after zero number bucket - 1; the ones before that are the subscribers before it.
+    return (long)(subscriberSelect0(store, bucket - 1) + 1 - bucket);
+}
+
+// Same result as verifyUser(): 1 if the subscriber exists with this technology and has paid,
+// 0 if not paid, -1 if there is no such subscriber and technology.
+static inline int subscriberStoreLookup(const SubscriberStore *store, unsigned long number, uint8_t technology) {
+    if (store->count == 0 || number > store->maxNumber || technology > SUBSCRIBER_MAX_TECHNOLOGY) {
+        return -1;
+    }
+    uint64_t bucket = number >> store->lowBits;
+    uint64_t low = number & ((1ULL << store->lowBits) - 1);
+    long index = subscriberBucketStart(store, bucket);
+    uint64_t position = bucket + (uint64_t)index;
+
+    // Walk the ones of this bucket; low parts are sorted within it.
+    while (position < store->highBits && (store->high[position >> 6] >> (position & 63) & 1)) {
+        uint64_t value = subscriberLowAt(store, index);
+        if (value > low) {
+            break;
+        }
+        if (value == low) {
+            int attributes = subscriberAttributesAt(store, index);
+            if ((attributes & 7) == technology) {
+                return attributes >> 3;
+            }
+        }
+        index++;
+        position++;
+    }
+    return -1;
+}
+
+// Number of subscribers (entries) with a number smaller than the given one.
+static inline long subscriberStoreRank(const SubscriberStore *store, unsigned long number) {
+    if (number > store->maxNumber) {
+        return store->count;
+    }
+    uint64_t bucket = number >> store->lowBits;
+    uint64_t low = number & ((1ULL << store->lowBits) - 1);
+    long index = subscriberBucketStart(store, bucket);
+    uint64_t position = bucket + (uint64_t)index;
+    while (position < store->highBits && (store->high[position >> 6] >> (position & 63) & 1) &&
+           subscriberLowAt(store, index) < low) {
+        index++;
+        position++;
+    }
+    return index;
+}
+
+// Number of the subscriber at the given index (0 <= index < count), in sorted order.
+static inline unsigned long subscriberStoreSelect(const SubscriberStore *store, long index) {
+    uint64_t position = subscriberSelect1(store, (uint64_t)index);
+    return (unsigned long)(((position - index) << store->lowBits) | subscriberLowAt(store, index));
+}
+
+// Look up count subscribers at once. Lookups are processed SUBSCRIBER_BATCH at a time:
+// the select samples and bit vector words of the whole group are prefetched before any
+// of them is used, so the cache misses of independent lookups overlap.
+static inline void subscriberStoreLookupBatch(const SubscriberStore *store, const unsigned long numbers[],
+                                              const uint8_t technologies[], long count, int results[]) {
+    for (long first = 0; first < count; first += SUBSCRIBER_BATCH) {
+        int group = (count - first < SUBSCRIBER_BATCH) ? (int)(count - first) : SUBSCRIBER_BATCH;
+        for (int i = 0; i < group; i++) {
+            uint64_t bucket = numbers[first + i] >> store->lowBits;
+            if (numbers[first + i] <= store->maxNumber && bucket > 0) {
+                __builtin_prefetch(&store->zeroSamples[(bucket - 1) / SUBSCRIBER_SAMPLE]);
+            }
+        }
+        for (int i = 0; i < group; i++) {
+            uint64_t bucket = numbers[first + i] >> store->lowBits;
+            if (numbers[first + i] <= store->maxNumber && bucket > 0) {
+                uint64_t position = store->zeroSamples[(bucket - 1) / SUBSCRIBER_SAMPLE];
+                __builtin_prefetch(&store->high[position >> 6]);
+                // The bucket's entries are roughly position - bucket; prefetch their low bits and attributes too.
+                uint64_t estimate = position > bucket ? position - bucket : 0;
+                __builtin_prefetch(&store->low[estimate * store->lowBits >> 6]);
+                __builtin_prefetch(&store->attributes[estimate >> 1]);
+            }
+        }
+        for (int i = 0; i < group; i++) {
+            results[first + i] = subscriberStoreLookup(store, numbers[first + i], technologies[first + i]);
+        }
+    }
+}
+
+// Memory used by the store, in bytes.
+static inline size_t subscriberStoreBytes(const SubscriberStore *store) {
+    return (((uint64_t)store->count * store->lowBits + 63) / 64 + 1) * sizeof(uint64_t) +
+           ((store->highBits + 63) / 64 + 1) * sizeof(uint64_t) + (store->count + 1) / 2 + 1 +
+           ((store->highBits - store->count) / SUBSCRIBER_SAMPLE + 1) * sizeof(uint64_t) +
+           (store->count / SUBSCRIBER_SAMPLE + 1) * sizeof(uint64_t);
+}
+
+static inline void subscriberStoreFree(SubscriberStore *store) {
+    free(store->low);
+    free(store->high);
+    free(store->attributes);
+    free(store->zeroSamples);
+    free(store->oneSamples);
+    memset(store, 0, sizeof(*store));
+}
+
+#endif
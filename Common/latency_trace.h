@@ -0,0 +1,418 @@
+// -----------------------------------------------------------------------------
+// Sampled Per-Packet Latency Tracing for the UDP Servers
+// -----------------------------------------------------------------------------
+//
+// For one packet in every sampleEvery, the tracer records where the time between
+// the packet arriving and the answer leaving was spent:
+//
+//   kernel rx     SO_TIMESTAMPING software receive timestamp (taken when the
+//                 kernel received the packet, before it was queued on the socket)
+//   recv          cycle counter when recvmsg() returned
+//   process       cycle counter around the server's packet handling, and
+//   lookup        around the subscriber lookup inside it (Assignment_2)
+//   send          cycle counter around the sendto()/sendmsg() of the answer
+//   kernel tx     SO_TIMESTAMPING software transmit timestamp, requested for the
+//                 sampled answer only and read back from the socket error queue
+//
+// The error queue is charged to the socket receive buffer, so when the server is
+// saturated the kernel drops some transmit timestamps. Each one carries the
+// OPT_ID key of its request, so the rest are still matched to the right sample.
+//
+// Kernel timestamps are CLOCK_REALTIME. Each sample also reads CLOCK_REALTIME once
+// when it is received, and its cycle counter values (rdtsc on x86, CLOCK_MONOTONIC
+// elsewhere) are placed relative to that reading. The cycle rate comes from
+// calibration points taken at start-up and at export time. Converting against the
+// start-up point alone drifts by microseconds over a long run (the cycle counter
+// and the system clock are not locked together), which is more than some stages last.
+//
+// Samples go to a fixed-size buffer. A slot is claimed with an atomic increment
+// and published with a release store of its sequence number, so recording never
+// takes a lock and the oldest samples are overwritten when the buffer is full.
+// latencyExport() writes the samples as Chrome trace-event JSON, which loads in
+// chrome://tracing and in Perfetto (ui.perfetto.dev), and prints percentiles per
+// stage.
+//
+// With tracing disabled, latencyRecvFrom() and latencySendTo() are plain
+// recvfrom()/sendto(). Kernel timestamps need Linux. Elsewhere only the cycle
+// counter stages are recorded.
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#define LATENCY_KERNEL_TIMESTAMPS 1
+#endif
+
+#define LATENCY_BUFFER_SIZE 65536         // Samples kept (power of two); older ones are overwritten.
+#define LATENCY_PENDING_TX 64             // Sampled answers waiting for their transmit timestamp.
+
+// Cycle counter stamps taken for a sampled packet.
+enum {
+    LATENCY_RECV,                         // recvmsg() returned.
+    LATENCY_PROCESS_START,                // Packet handling started.
+    LATENCY_LOOKUP_START,                 // Subscriber lookup started (Assignment_2 only).
+    LATENCY_LOOKUP_END,                   // Subscriber lookup finished.
+    LATENCY_PROCESS_END,                  // Packet handling finished.
+    LATENCY_SEND_START,                   // First answer about to be sent.
+    LATENCY_SEND_END,                     // Last answer sent.
+    LATENCY_STAGES
+};
+
+typedef struct LatencySample {
+    _Atomic uint64_t sequence;            // Packet number + 1 once the sample is complete, 0 while it is written.
+    uint64_t packet;                      // Number of the packet since the server started.
+    uint64_t rxKernelNs;                  // Kernel receive timestamp (CLOCK_REALTIME), 0 if not available.
+    uint64_t txKernelNs;                  // Kernel transmit timestamp (CLOCK_REALTIME), 0 if not available.
+    uint64_t anchorNs;                    // CLOCK_REALTIME read together with cycles[LATENCY_RECV].
+    uint64_t cycles[LATENCY_STAGES];      // Cycle counter per stage, 0 if the stage was not reached.
+} LatencySample;
+
+typedef struct LatencyTracer {
+    int enabled;
+    int kernelTimestamps;                 // SO_TIMESTAMPING was accepted by the kernel.
+    unsigned sampleEvery;
+    uint64_t packets;                     // Packets received while tracing.
+    _Atomic uint64_t nextSlot;
+    LatencySample *samples;
+    LatencySample *pendingTx[LATENCY_PENDING_TX]; // Indexed by OPT_ID key modulo LATENCY_PENDING_TX.
+    uint32_t pendingHead, pendingTail;    // Next key to be requested, oldest key still waiting.
+    uint64_t startCycles, startMonotonicNs, startRealtimeNs; // Calibration point at start-up.
+} LatencyTracer;
+
+// Sample being recorded by this thread, or NULL if the current packet is not sampled.
+static __thread LatencySample *latencyCurrent;
+
+static inline uint64_t latencyCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline uint64_t latencyClockNs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Record the cycle counter for a stage of the current packet, if it is sampled.
+static inline void latencyStamp(int stage) {
+    if (latencyCurrent != NULL) {
+        latencyCurrent->cycles[stage] = latencyCycles();
+    }
+}
+
+// Set up tracing on sockfd, sampling one packet in sampleEvery. sampleEvery 0 leaves tracing off.
+// Returns 0, or -1 if the sample buffer could not be allocated.
+static inline int latencyTracerInit(LatencyTracer *tracer, int sockfd, unsigned sampleEvery) {
+    memset(tracer, 0, sizeof(*tracer));
+    if (sampleEvery == 0) {
+        return 0;
+    }
+    tracer->samples = calloc(LATENCY_BUFFER_SIZE, sizeof(LatencySample));
+    if (tracer->samples == NULL) {
+        return -1;
+    }
+    tracer->enabled = 1;
+    tracer->sampleEvery = sampleEvery;
+#ifdef LATENCY_KERNEL_TIMESTAMPS
+    // Receive timestamps for every packet (only the sampled ones are used); transmit
+    // timestamps are requested per answer. OPT_TSONLY keeps the payload off the error queue.
+    // OPT_ID numbers the timestamped sends from 0, which is how pendingTx is indexed.
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY |
+                SOF_TIMESTAMPING_OPT_ID;
+    tracer->kernelTimestamps = setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+#else
+    (void)sockfd;
+#endif
+    tracer->startCycles = latencyCycles();
+    tracer->startMonotonicNs = latencyClockNs(CLOCK_MONOTONIC);
+    tracer->startRealtimeNs = latencyClockNs(CLOCK_REALTIME);
+    return 0;
+}
+
+// recvfrom() that also picks up the kernel receive timestamp and starts a sample for every
+// sampleEvery-th packet. The packet handling and answer must follow before latencyEndPacket().
+static inline ssize_t latencyRecvFrom(LatencyTracer *tracer, int sockfd, void *buffer, size_t len,
+                                      struct sockaddr_in *from, socklen_t *fromLen) {
+    if (!tracer->enabled) {
+        return recvfrom(sockfd, buffer, len, 0, (struct sockaddr *)from, fromLen);
+    }
+    struct iovec iov = {buffer, len};
+    char control[256];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = from;
+    msg.msg_namelen = *fromLen;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t received = recvmsg(sockfd, &msg, 0);
+    uint64_t now = latencyCycles();
+    *fromLen = msg.msg_namelen;
+    if (received < 0 || tracer->packets++ % tracer->sampleEvery != 0) {
+        return received;
+    }
+
+    uint64_t slot = atomic_fetch_add_explicit(&tracer->nextSlot, 1, memory_order_relaxed);
+    LatencySample *sample = &tracer->samples[slot & (LATENCY_BUFFER_SIZE - 1)];
+    atomic_store_explicit(&sample->sequence, 0, memory_order_relaxed);
+    memset(sample->cycles, 0, sizeof(sample->cycles));
+    sample->packet = tracer->packets - 1;
+    sample->rxKernelNs = 0;
+    sample->txKernelNs = 0;
+    sample->cycles[LATENCY_RECV] = now;
+    sample->anchorNs = latencyClockNs(CLOCK_REALTIME);
+#ifdef LATENCY_KERNEL_TIMESTAMPS
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            struct scm_timestamping stamps;
+            memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+            sample->rxKernelNs = (uint64_t)stamps.ts[0].tv_sec * 1000000000ULL + stamps.ts[0].tv_nsec;
+        }
+    }
+#endif
+    latencyCurrent = sample;
+    return received;
+}
+
+// Read transmit timestamps from the error queue and hand them to the waiting samples by key.
+// Samples older than a received key lost their timestamp and stop waiting.
+static inline void latencyReadTxTimestamps(LatencyTracer *tracer, int sockfd) {
+#ifdef LATENCY_KERNEL_TIMESTAMPS
+    while (tracer->pendingHead != tracer->pendingTail) {
+        char control[256];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return;
+        }
+        uint64_t stampNs = 0;
+        int haveKey = 0;
+        uint32_t key = 0;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                struct scm_timestamping stamps;
+                memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+                stampNs = (uint64_t)stamps.ts[0].tv_sec * 1000000000ULL + stamps.ts[0].tv_nsec;
+            } else if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVERR) {
+                struct sock_extended_err error;
+                memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+                if (error.ee_errno == ENOMSG && error.ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+                    key = error.ee_data;
+                    haveKey = 1;
+                }
+            }
+        }
+        // Keys outside the waiting window are stale and ignored.
+        if (!haveKey || stampNs == 0 || key - tracer->pendingTail >= tracer->pendingHead - tracer->pendingTail) {
+            continue;
+        }
+        tracer->pendingTx[key % LATENCY_PENDING_TX]->txKernelNs = stampNs;
+        tracer->pendingTail = key + 1;
+    }
+#else
+    (void)tracer;
+    (void)sockfd;
+#endif
+}
+
+// sendto() that, for the first answer to a sampled packet, stamps the send stages and asks
+// the kernel for a transmit timestamp.
+static inline ssize_t latencySendTo(LatencyTracer *tracer, int sockfd, const void *buffer, size_t len,
+                                    const struct sockaddr_in *to, socklen_t toLen) {
+    LatencySample *sample = latencyCurrent;
+    if (!tracer->enabled || sample == NULL) {
+        return sendto(sockfd, buffer, len, 0, (const struct sockaddr *)to, toLen);
+    }
+    ssize_t sent;
+    if (sample->cycles[LATENCY_SEND_START] == 0) {
+        sample->cycles[LATENCY_SEND_START] = latencyCycles();
+#ifdef LATENCY_KERNEL_TIMESTAMPS
+        if (tracer->kernelTimestamps) {
+            // A full window means the oldest timestamp is not coming; stop waiting for it.
+            if (tracer->pendingHead - tracer->pendingTail == LATENCY_PENDING_TX) {
+                tracer->pendingTail++;
+            }
+            struct iovec iov = {(void *)buffer, len};
+            char control[CMSG_SPACE(sizeof(uint32_t))];
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            memset(control, 0, sizeof(control));
+            msg.msg_name = (void *)to;
+            msg.msg_namelen = toLen;
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SO_TIMESTAMPING;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+            uint32_t flags = SOF_TIMESTAMPING_TX_SOFTWARE;
+            memcpy(CMSG_DATA(cmsg), &flags, sizeof(flags));
+            sent = sendmsg(sockfd, &msg, 0);
+            if (sent >= 0) {
+                tracer->pendingTx[tracer->pendingHead++ % LATENCY_PENDING_TX] = sample;
+            }
+            sample->cycles[LATENCY_SEND_END] = latencyCycles();
+            return sent;
+        }
+#endif
+    }
+    sent = sendto(sockfd, buffer, len, 0, (const struct sockaddr *)to, toLen);
+    sample->cycles[LATENCY_SEND_END] = latencyCycles();
+    return sent;
+}
+
+// Finish the current packet: publish its sample and collect transmit timestamps.
+// A transmit timestamp that is not queued yet is filled in when a later sample ends.
+static inline void latencyEndPacket(LatencyTracer *tracer, int sockfd) {
+    LatencySample *sample = latencyCurrent;
+    if (sample == NULL) {
+        return;
+    }
+    latencyCurrent = NULL;
+    latencyReadTxTimestamps(tracer, sockfd);
+    atomic_store_explicit(&sample->sequence, sample->packet + 1, memory_order_release);
+}
+
+// Cycle counter value of a sample to CLOCK_REALTIME nanoseconds, relative to the sample's anchor.
+static inline uint64_t latencyCyclesToNs(const LatencySample *sample, uint64_t cycles, double nsPerCycle) {
+    return sample->anchorNs + (uint64_t)((double)(cycles - sample->cycles[LATENCY_RECV]) * nsPerCycle);
+}
+
+static inline int latencyCompareDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// One Chrome trace "complete" event; times in CLOCK_REALTIME nanoseconds.
+static inline void latencyWriteEvent(FILE *file, int *first, const char *name, int track, uint64_t startNs, uint64_t endNs,
+                                     uint64_t baseNs, uint64_t packet) {
+    if (startNs == 0 || endNs < startNs) {
+        return;
+    }
+    fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"packet\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"packet\":%llu}}",
+            *first ? "" : ",", name, track, (startNs - baseNs) / 1e3, (endNs - startNs) / 1e3, (unsigned long long)packet);
+    *first = 0;
+}
+
+// Write the samples as Chrome trace-event JSON to path and print per-stage percentiles.
+// Returns the number of samples written, or -1 if the file could not be created.
+static inline long latencyExport(LatencyTracer *tracer, const char *path) {
+    if (!tracer->enabled) {
+        return 0;
+    }
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    uint64_t endCycles = latencyCycles();
+    uint64_t endMonotonicNs = latencyClockNs(CLOCK_MONOTONIC);
+    double nsPerCycle = endCycles > tracer->startCycles
+                            ? (double)(endMonotonicNs - tracer->startMonotonicNs) / (double)(endCycles - tracer->startCycles)
+                            : 1.0;
+
+    // The stages reported, as pairs of points. Point -1 is the kernel receive, -2 the kernel transmit.
+    static const struct { const char *name; int track; int from; int to; } spans[] = {
+        {"socket queue", 1, -1, LATENCY_RECV},
+        {"recv to process", 2, LATENCY_RECV, LATENCY_PROCESS_START},
+        {"process", 2, LATENCY_PROCESS_START, LATENCY_PROCESS_END},
+        {"lookup", 3, LATENCY_LOOKUP_START, LATENCY_LOOKUP_END},
+        {"process to send", 2, LATENCY_PROCESS_END, LATENCY_SEND_START},
+        {"send syscall", 2, LATENCY_SEND_START, LATENCY_SEND_END},
+        {"kernel tx", 4, LATENCY_SEND_START, -2},
+        {"total", 5, -1, LATENCY_SEND_END},
+    };
+    int spanCount = sizeof(spans) / sizeof(spans[0]);
+    long available = atomic_load(&tracer->nextSlot) < LATENCY_BUFFER_SIZE ? (long)atomic_load(&tracer->nextSlot) : LATENCY_BUFFER_SIZE;
+    double *durations = malloc(sizeof(double) * (available + 1) * spanCount);
+    long durationCount[16] = {0};
+    if (durations == NULL) {
+        fclose(file);
+        return -1;
+    }
+
+    uint64_t baseNs = tracer->startRealtimeNs;
+    int first = 1;
+    long written = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    fprintf(file, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"kernel rx / socket queue\"}},"
+                  "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"server\"}},"
+                  "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":3,\"args\":{\"name\":\"lookup\"}},"
+                  "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":4,\"args\":{\"name\":\"kernel tx\"}},"
+                  "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":5,\"args\":{\"name\":\"packet total\"}}");
+    first = 0;
+    for (long i = 0; i < available; i++) {
+        LatencySample *sample = &tracer->samples[i];
+        if (atomic_load_explicit(&sample->sequence, memory_order_acquire) == 0) {
+            continue;
+        }
+        for (int s = 0; s < spanCount; s++) {
+            uint64_t from = spans[s].from == -1 ? sample->rxKernelNs
+                            : (sample->cycles[spans[s].from] ? latencyCyclesToNs(sample, sample->cycles[spans[s].from], nsPerCycle) : 0);
+            uint64_t to = spans[s].to == -2 ? sample->txKernelNs
+                          : (sample->cycles[spans[s].to] ? latencyCyclesToNs(sample, sample->cycles[spans[s].to], nsPerCycle) : 0);
+            // Without a kernel receive timestamp the total starts at recv.
+            if (spans[s].from == -1 && from == 0 && spans[s].to == LATENCY_SEND_END && sample->cycles[LATENCY_RECV]) {
+                from = latencyCyclesToNs(sample, sample->cycles[LATENCY_RECV], nsPerCycle);
+            }
+            if (from == 0 || to == 0 || to < from) {
+                continue;
+            }
+            latencyWriteEvent(file, &first, spans[s].name, spans[s].track, from, to, baseNs, sample->packet);
+            durations[(long)s * (available + 1) + durationCount[s]++] = (to - from) / 1e3;
+        }
+        written++;
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("Latency samples: %ld (1 in %u packets, kernel timestamps %s)\n", written, tracer->sampleEvery,
+           tracer->kernelTimestamps ? "on" : "off");
+    printf("%-18s %8s %10s %10s %10s\n", "stage", "samples", "p50_us", "p99_us", "max_us");
+    for (int s = 0; s < spanCount; s++) {
+        long count = durationCount[s];
+        double *values = &durations[(long)s * (available + 1)];
+        if (count == 0) {
+            continue;
+        }
+        qsort(values, count, sizeof(double), latencyCompareDouble);
+        printf("%-18s %8ld %10.2f %10.2f %10.2f\n", spans[s].name, count, values[count / 2],
+               values[(long)(count * 0.99)], values[count - 1]);
+    }
+    free(durations);
+    return written;
+}
+
+static inline void latencyTracerFree(LatencyTracer *tracer) {
+    free(tracer->samples);
+    tracer->samples = NULL;
+    tracer->enabled = 0;
+}
+
+#endif
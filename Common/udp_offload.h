@@ -0,0 +1,151 @@
+// -----------------------------------------------------------------------------
+// UDP Segmentation Offload (GSO) and Receive Coalescing (GRO)
+// -----------------------------------------------------------------------------
+//
+// GSO: the sender hands the kernel one buffer holding several equally sized
+// datagrams (the last may be shorter) and the UDP_SEGMENT size, so the stack is
+// traversed once per buffer instead of once per datagram.
+//
+// GRO: with UDP_GRO enabled, the kernel may deliver several datagrams from the
+// same sender as one coalesced read; a UDP_GRO control message gives the size of
+// each segment so the receiver can split them again.
+//
+// udpSendBatch() sends the answers to one coalesced read with a single sendmmsg()
+// when the including file defines _GNU_SOURCE, and with sendto() otherwise.
+//
+// GSO and GRO are Linux-only (4.18 for GSO, 5.0 for GRO). On other systems, or when the
+// kernel rejects the option, the functions return -1 and the caller falls back
+// to one datagram per syscall.
+
+#ifndef UDP_OFFLOAD_H
+#define UDP_OFFLOAD_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#define UDP_OFFLOAD_SUPPORTED 1
+#endif
+
+#define UDP_GSO_MAX_SEGMENTS 64           // Segments the kernel accepts in one GSO buffer.
+#define UDP_GRO_BUFFER_SIZE 65536         // Read size needed to receive a fully coalesced buffer.
+
+// Send count datagrams of segSize bytes each, stored back to back in buffer, with one sendmsg().
+// Returns the number of bytes sent, or -1 if GSO is not available (nothing was sent in that case).
+static inline int udpGsoSend(int sockfd, const void *buffer, int segSize, int count,
+                             const struct sockaddr *to, socklen_t toLen) {
+#ifdef UDP_OFFLOAD_SUPPORTED
+    if (count <= 0 || count > UDP_GSO_MAX_SEGMENTS) {
+        return -1;
+    }
+    struct iovec iov;
+    struct msghdr msg;
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    iov.iov_base = (void *)buffer;
+    iov.iov_len = (size_t)segSize * count;
+    msg.msg_name = (void *)to;
+    msg.msg_namelen = toLen;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    uint16_t gsoSize = (uint16_t)segSize;
+    memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+
+    return (int)sendmsg(sockfd, &msg, 0);
+#else
+    (void)sockfd; (void)buffer; (void)segSize; (void)count; (void)to; (void)toLen;
+    return -1;
+#endif
+}
+
+// Ask the kernel to coalesce received datagrams. Returns 0 on success, -1 if unsupported.
+static inline int udpGroEnable(int sockfd) {
+#ifdef UDP_OFFLOAD_SUPPORTED
+    int on = 1;
+    return setsockopt(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on));
+#else
+    (void)sockfd;
+    return -1;
+#endif
+}
+
+// Segment size of a coalesced read, or 0 if the read holds a single datagram.
+static inline int udpGroSegmentSize(struct msghdr *msg) {
+#ifdef UDP_OFFLOAD_SUPPORTED
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int segSize;
+            memcpy(&segSize, CMSG_DATA(cmsg), sizeof(segSize));
+            return segSize;
+        }
+    }
+#else
+    (void)msg;
+#endif
+    return 0;
+}
+
+// Send count buffers to the same address, continuing after partial sends until every buffer is out
+// or sendmmsg() fails with a real error. Returns the number of syscalls used.
+static inline int udpSendBatch(int sockfd, void *const buffers[], const int lens[], int count,
+                               const struct sockaddr *to, socklen_t toLen) {
+#if defined(UDP_OFFLOAD_SUPPORTED) && defined(_GNU_SOURCE)
+    struct mmsghdr msgs[UDP_GSO_MAX_SEGMENTS];
+    struct iovec iovs[UDP_GSO_MAX_SEGMENTS];
+    int syscalls = 0;
+    for (int first = 0; first < count; first += UDP_GSO_MAX_SEGMENTS) {
+        int batch = (count - first < UDP_GSO_MAX_SEGMENTS) ? count - first : UDP_GSO_MAX_SEGMENTS;
+        memset(msgs, 0, sizeof(struct mmsghdr) * batch);
+        for (int i = 0; i < batch; i++) {
+            iovs[i].iov_base = buffers[first + i];
+            iovs[i].iov_len = lens[first + i];
+            msgs[i].msg_hdr.msg_name = (void *)to;
+            msgs[i].msg_hdr.msg_namelen = toLen;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        for (int done = 0; done < batch;) {
+            int sent = sendmmsg(sockfd, msgs + done, batch - done, 0);
+            syscalls++;
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return syscalls;
+            }
+            done += sent;
+        }
+    }
+    return syscalls;
+#else
+    for (int i = 0; i < count; i++) {
+        sendto(sockfd, buffers[i], lens[i], 0, to, toLen);
+    }
+    return count;
+#endif
+}
+
+#endif
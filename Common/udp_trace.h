@@ -0,0 +1,232 @@
+// -----------------------------------------------------------------------------
+// Packet Capture Traces for the UDP Servers
+// -----------------------------------------------------------------------------
+//
+// A trace is a 16-byte file header followed by records. Each record has a 16-byte
+// header (receive time, source address and port, payload length) and the datagram
+// payload, padded to 8 bytes.
+//
+// The writer never calls write() per packet. The file grows in chunks of
+// TRACE_CHUNK_SIZE bytes. The current chunk is mapped into memory and records are
+// copied into it. When a chunk is full it is unmapped (the kernel writes it back
+// in the background), the file is extended and the next chunk is mapped. A record
+// never straddles two chunks: the rest of a full chunk is marked as padding. On a
+// clean close the file is cut to the bytes actually used. After a crash the
+// unused tail of the last chunk is zero, which the reader takes as the end.
+//
+// Timestamps are CLOCK_REALTIME in nanoseconds, so a capture can be lined up with
+// other logs. Replay only uses the differences between them.
+
+#ifndef UDP_TRACE_H
+#define UDP_TRACE_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRACE_MAGIC "UDPTRC01"            // First 8 bytes of every trace.
+#define TRACE_VERSION 1
+#define TRACE_CHUNK_SIZE (4 << 20)        // Bytes mapped at a time by the writer.
+#define TRACE_PAD 0XFFFF                  // Record length marking the rest of a chunk as unused.
+#define TRACE_MAX_PAYLOAD 65507           // Largest UDP payload over IPv4.
+
+typedef struct TraceFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunkSize;
+} TraceFileHeader;
+
+typedef struct TraceRecord {
+    uint64_t timestampNs;                 // Receive time (CLOCK_REALTIME), never 0.
+    uint32_t address;                     // Source IPv4 address, network byte order.
+    uint16_t port;                        // Source port, network byte order.
+    uint16_t length;                      // Payload bytes that follow, or TRACE_PAD.
+} TraceRecord;
+
+typedef struct TraceWriter {
+    int fd;
+    unsigned char *chunk;                 // Mapped chunk, or NULL once the writer has failed.
+    off_t chunkOffset;                    // File offset of the mapped chunk.
+    size_t used;                          // Bytes used in the mapped chunk.
+    long records;                         // Datagrams captured.
+} TraceWriter;
+
+typedef struct TraceReader {
+    unsigned char *data;
+    size_t size;
+    size_t offset;
+    uint32_t chunkSize;
+} TraceReader;
+
+static inline size_t traceRecordSize(int length) {
+    return sizeof(TraceRecord) + (((size_t)length + 7) & ~(size_t)7);
+}
+
+// Extend the file by one chunk and map it. Returns 0 on success.
+static inline int traceMapChunk(TraceWriter *writer) {
+    if (ftruncate(writer->fd, writer->chunkOffset + TRACE_CHUNK_SIZE) < 0) {
+        return -1;
+    }
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    // Fault the whole chunk in now rather than one page at a time while packets arrive.
+    flags |= MAP_POPULATE;
+#endif
+    void *chunk = mmap(NULL, TRACE_CHUNK_SIZE, PROT_READ | PROT_WRITE, flags, writer->fd, writer->chunkOffset);
+    if (chunk == MAP_FAILED) {
+        return -1;
+    }
+    writer->chunk = chunk;
+    writer->used = 0;
+    return 0;
+}
+
+// Create (or truncate) a trace file. Returns 0 on success, -1 on error.
+static inline int traceWriterOpen(TraceWriter *writer, const char *path) {
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0 || traceMapChunk(writer) < 0) {
+        if (writer->fd >= 0) {
+            close(writer->fd);
+        }
+        writer->chunk = NULL;
+        return -1;
+    }
+    TraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.chunkSize = TRACE_CHUNK_SIZE;
+    memcpy(writer->chunk, &header, sizeof(header));
+    writer->used = sizeof(header);
+    return 0;
+}
+
+// Append one received datagram. Does nothing if writer is NULL or has failed.
+static inline void traceWriterAppend(TraceWriter *writer, const void *payload, int length, const struct sockaddr_in *from) {
+    if (writer == NULL || writer->chunk == NULL || length < 0) {
+        return;
+    }
+    if (length > TRACE_MAX_PAYLOAD) {
+        length = TRACE_MAX_PAYLOAD;
+    }
+    size_t needed = traceRecordSize(length);
+
+    // Move to the next chunk, marking what is left of this one as padding.
+    if (writer->used + needed > TRACE_CHUNK_SIZE) {
+        if (writer->used + sizeof(TraceRecord) <= TRACE_CHUNK_SIZE) {
+            TraceRecord pad = {1, 0, 0, TRACE_PAD};
+            memcpy(writer->chunk + writer->used, &pad, sizeof(pad));
+        }
+        munmap(writer->chunk, TRACE_CHUNK_SIZE);
+        writer->chunk = NULL;
+        writer->chunkOffset += TRACE_CHUNK_SIZE;
+        if (traceMapChunk(writer) < 0) {
+            printf("\nERROR - THE CAPTURE FILE COULD NOT BE EXTENDED, CAPTURE STOPPED.\n");
+            return;
+        }
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    TraceRecord record;
+    record.timestampNs = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    record.address = from != NULL ? from->sin_addr.s_addr : 0;
+    record.port = from != NULL ? from->sin_port : 0;
+    record.length = (uint16_t)length;
+    memcpy(writer->chunk + writer->used, &record, sizeof(record));
+    memcpy(writer->chunk + writer->used + sizeof(record), payload, length);
+    writer->used += needed;
+    writer->records++;
+}
+
+// Unmap the last chunk and cut the file to the bytes written.
+static inline void traceWriterClose(TraceWriter *writer) {
+    if (writer->chunk != NULL) {
+        munmap(writer->chunk, TRACE_CHUNK_SIZE);
+        if (ftruncate(writer->fd, writer->chunkOffset + (off_t)writer->used) < 0) {
+            printf("\nERROR - THE CAPTURE FILE COULD NOT BE TRUNCATED.\n");
+        }
+        writer->chunk = NULL;
+    }
+    if (writer->fd >= 0) {
+        close(writer->fd);
+        writer->fd = -1;
+    }
+}
+
+// Map a trace for reading. Returns 0 on success, -1 if it cannot be read or is not a trace.
+static inline int traceReaderOpen(TraceReader *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(TraceFileHeader)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    TraceFileHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 || header.version != TRACE_VERSION ||
+        header.chunkSize == 0) {
+        munmap(data, info.st_size);
+        return -1;
+    }
+    reader->data = data;
+    reader->size = info.st_size;
+    reader->offset = sizeof(header);
+    reader->chunkSize = header.chunkSize;
+    return 0;
+}
+
+// Next record, with its payload right after it, or NULL at the end of the trace.
+static inline const TraceRecord *traceReaderNext(TraceReader *reader) {
+    while (reader->offset + sizeof(TraceRecord) <= reader->size) {
+        // Too little room was left at the end of a chunk for even a padding record.
+        if (reader->chunkSize - reader->offset % reader->chunkSize < sizeof(TraceRecord)) {
+            reader->offset += reader->chunkSize - reader->offset % reader->chunkSize;
+            continue;
+        }
+        const TraceRecord *record = (const TraceRecord *)(reader->data + reader->offset);
+        if (record->timestampNs == 0) {
+            return NULL;
+        }
+        if (record->length == TRACE_PAD) {
+            reader->offset += reader->chunkSize - reader->offset % reader->chunkSize;
+            continue;
+        }
+        size_t size = traceRecordSize(record->length);
+        if (reader->offset + size > reader->size) {
+            return NULL;
+        }
+        reader->offset += size;
+        return record;
+    }
+    return NULL;
+}
+
+// Start reading from the first record again.
+static inline void traceReaderRewind(TraceReader *reader) {
+    reader->offset = sizeof(TraceFileHeader);
+}
+
+static inline void traceReaderClose(TraceReader *reader) {
+    if (reader->data != NULL) {
+        munmap(reader->data, reader->size);
+        reader->data = NULL;
+    }
+}
+
+#endif
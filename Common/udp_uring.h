@@ -0,0 +1,493 @@
+// -----------------------------------------------------------------------------
+// io_uring Receive/Send Engine for the UDP Servers
+// -----------------------------------------------------------------------------
+//
+// An alternative to the blocking recvfrom()/sendto() loop. A single multishot
+// recvmsg request stays armed on the socket and fills buffers from a provided
+// buffer ring, so no receive has to be resubmitted per packet. Responses are
+// queued as sendmsg requests (optionally linked so several responses to one packet
+// go out in order) and submitted together with the wait for the next completions,
+// which is one io_uring_enter() per batch of packets instead of two syscalls per
+// packet. With SQPOLL a kernel thread picks up submissions, and the loop only
+// enters the kernel when the completion queue has been empty for a while.
+//
+// Talks to the kernel through the raw syscalls, so liburing is not required.
+// Needs Linux 6.0+ (provided buffer rings and multishot recvmsg). On other
+// systems, or when the kernel refuses the setup, udpUringInit() returns -1 and
+// the server keeps using the classic loop.
+
+#ifndef UDP_URING_H
+#define UDP_URING_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define UDP_URING_SUPPORTED 1
+#endif
+#endif
+
+#define URING_ENTRIES 256                 // Submission queue size.
+#define URING_RECV_BUFFERS 1024           // Buffers in the provided buffer ring (power of two).
+#define URING_RECV_BUFFER_SIZE 2048       // Size of each receive buffer.
+#define URING_SEND_SLOTS 1024             // Responses that can be in flight at once.
+#define URING_SEND_SIZE 512               // Largest response the engine will send.
+#define URING_BUFFER_GROUP 0              // Buffer group id of the provided buffer ring.
+#define URING_RECV_TAG UINT64_MAX         // user_data of the multishot receive request.
+#define URING_SPIN_LOOPS 20000            // SQPOLL mode: empty completion checks before sleeping in the kernel.
+
+#ifdef UDP_URING_SUPPORTED
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// One queued response and everything sendmsg needs to stay valid until it completes.
+typedef struct UdpUringSend {
+    struct msghdr msg;
+    struct iovec iov;
+    struct sockaddr_in to;
+    unsigned char data[URING_SEND_SIZE];
+} UdpUringSend;
+
+typedef struct UdpUring {
+    int ringFd;
+    int sockfd;
+    int sqpoll;
+
+    // Submission queue.
+    unsigned *sqHead, *sqTail, *sqMask, *sqFlags, *sqArray;
+    unsigned sqEntries;
+    unsigned sqLocalTail;                 // Tail including entries not yet published to the kernel.
+    struct io_uring_sqe *sqes;
+
+    // Completion queue.
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+
+    // Mappings, kept for teardown.
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+
+    // Provided buffer ring for the multishot receive.
+    struct io_uring_buf_ring *bufRing;
+    unsigned char *bufMemory;
+    unsigned bufTail;
+    struct msghdr recvMsg;
+    int recvArmed;
+
+    // Pool of send slots.
+    UdpUringSend *sends;
+    int *freeSends;
+    int freeCount;
+    struct io_uring_sqe *openLink;        // Last queued send with IOSQE_IO_LINK, until the next send is queued.
+
+    // Statistics.
+    long packets;                         // Datagrams received.
+    long responses;                       // Responses queued.
+    long sendDrops;                       // Responses dropped because every send slot was busy.
+    long syscalls;                        // io_uring_enter() calls.
+} UdpUring;
+
+// Called for every received datagram. Use udpUringSend() to answer it.
+typedef void (*UdpUringHandler)(UdpUring *ring, void *context, void *packet, int len, struct sockaddr_in *from);
+
+static inline int udpUringEnter(UdpUring *ring, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    ring->syscalls++;
+    return (int)syscall(__NR_io_uring_enter, ring->ringFd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+// Publish queued SQEs. Without SQPOLL they are handed over by the next udpUringEnter().
+static inline unsigned udpUringPublish(UdpUring *ring) {
+    unsigned pending = ring->sqLocalTail - *ring->sqTail;
+    __atomic_store_n(ring->sqTail, ring->sqLocalTail, __ATOMIC_RELEASE);
+    return pending;
+}
+
+// Make sure count more SQEs fit in the submission queue. Returns 0 if they do, -1 otherwise.
+static inline int udpUringMakeRoom(UdpUring *ring, unsigned count) {
+    unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    if (ring->sqLocalTail - head + count > ring->sqEntries) {
+        // Queue full: hand what we have to the kernel first.
+        unsigned pending = udpUringPublish(ring);
+        if (ring->sqpoll) {
+            udpUringEnter(ring, 0, 0, IORING_ENTER_SQ_WAKEUP | IORING_ENTER_SQ_WAIT);
+        } else {
+            udpUringEnter(ring, pending, 0, 0);
+        }
+        head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+        if (ring->sqLocalTail - head + count > ring->sqEntries) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline struct io_uring_sqe *udpUringGetSqe(UdpUring *ring) {
+    if (udpUringMakeRoom(ring, 1) < 0) {
+        return NULL;
+    }
+    unsigned index = ring->sqLocalTail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqArray[index] = index;
+    ring->sqLocalTail++;
+    return sqe;
+}
+
+static inline int udpUringArmRecv(UdpUring *ring) {
+    struct io_uring_sqe *sqe = udpUringGetSqe(ring);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = ring->sockfd;
+    sqe->addr = (uint64_t)(uintptr_t)&ring->recvMsg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = URING_RECV_TAG;
+    ring->recvArmed = 1;
+    return 0;
+}
+
+// Give a receive buffer back to the kernel. The new tail is published once per batch.
+static inline void udpUringRecycle(UdpUring *ring, unsigned bid) {
+    struct io_uring_buf *buf = &ring->bufRing->bufs[ring->bufTail & (URING_RECV_BUFFERS - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ring->bufMemory + (size_t)bid * URING_RECV_BUFFER_SIZE);
+    buf->len = URING_RECV_BUFFER_SIZE;
+    buf->bid = bid;
+    ring->bufTail++;
+}
+
+// Reserve send slots and SQEs for count responses to one packet, before queuing the first of them.
+// Linked responses then cannot be cut short by a full queue, which would leave the link on whatever
+// request is queued next. Returns 0 on success, or -1 (counting the responses as dropped) if there is
+// no room for all of them.
+static inline int udpUringReserve(UdpUring *ring, int count) {
+    if (ring->freeCount < count || udpUringMakeRoom(ring, (unsigned)count) < 0) {
+        ring->sendDrops += count;
+        return -1;
+    }
+    return 0;
+}
+
+// A linked response is followed by a dropped one: end the chain at the last response queued.
+// That SQE is not published yet, since nothing is handed to the kernel between linked responses
+// that were reserved with udpUringReserve().
+static inline void udpUringDropSend(UdpUring *ring) {
+    if (ring->openLink != NULL) {
+        ring->openLink->flags &= ~IOSQE_IO_LINK;
+        ring->openLink = NULL;
+    }
+    ring->sendDrops++;
+}
+
+// Queue a response. linkNext keeps it ordered before the next response queued for the same packet;
+// reserve room for all of them first with udpUringReserve().
+// Returns 0 on success, -1 if the response was dropped.
+static inline int udpUringSend(UdpUring *ring, const void *data, int len, const struct sockaddr_in *to, int linkNext) {
+    if (len > URING_SEND_SIZE || ring->freeCount == 0) {
+        udpUringDropSend(ring);
+        return -1;
+    }
+    struct io_uring_sqe *sqe = udpUringGetSqe(ring);
+    if (sqe == NULL) {
+        udpUringDropSend(ring);
+        return -1;
+    }
+    int slotIndex = ring->freeSends[--ring->freeCount];
+    UdpUringSend *slot = &ring->sends[slotIndex];
+    memcpy(slot->data, data, len);
+    slot->to = *to;
+    slot->iov.iov_base = slot->data;
+    slot->iov.iov_len = len;
+    memset(&slot->msg, 0, sizeof(slot->msg));
+    slot->msg.msg_name = &slot->to;
+    slot->msg.msg_namelen = sizeof(slot->to);
+    slot->msg.msg_iov = &slot->iov;
+    slot->msg.msg_iovlen = 1;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = ring->sockfd;
+    sqe->addr = (uint64_t)(uintptr_t)&slot->msg;
+    sqe->len = 1;
+    sqe->flags = linkNext ? IOSQE_IO_LINK : 0;
+    sqe->user_data = (uint64_t)slotIndex;
+    ring->openLink = linkNext ? sqe : NULL;
+    ring->responses++;
+    return 0;
+}
+
+static inline void udpUringClose(UdpUring *ring) {
+    if (ring->bufRing != NULL) {
+        munmap(ring->bufRing, URING_RECV_BUFFERS * sizeof(struct io_uring_buf));
+    }
+    free(ring->bufMemory);
+    free(ring->sends);
+    free(ring->freeSends);
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    if (ring->cqRing != NULL && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing != NULL) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    if (ring->ringFd >= 0) {
+        close(ring->ringFd);
+    }
+    ring->ringFd = -1;
+}
+
+// Set up the ring, the provided buffer ring and the send slots for sockfd.
+// Returns 0 on success, or -1 if io_uring (or one of the required features) is unavailable.
+static inline int udpUringInit(UdpUring *ring, int sockfd, int sqpoll) {
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->ringFd = -1;
+    ring->sockfd = sockfd;
+    ring->sqpoll = sqpoll;
+    if (sqpoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = 2000;
+    }
+
+    ring->ringFd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring->ringFd < 0) {
+        return -1;
+    }
+
+    // Map the submission and completion rings and the SQE array.
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) {
+            ring->sqRingSize = ring->cqRingSize;
+        }
+        ring->cqRingSize = ring->sqRingSize;
+    }
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->ringFd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        ring->sqRing = NULL;
+        udpUringClose(ring);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    } else {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->ringFd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) {
+            ring->cqRing = NULL;
+            udpUringClose(ring);
+            return -1;
+        }
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ringFd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        udpUringClose(ring);
+        return -1;
+    }
+
+    unsigned char *sq = ring->sqRing;
+    unsigned char *cq = ring->cqRing;
+    ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqFlags = (unsigned *)(sq + params.sq_off.flags);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring->sqEntries = params.sq_entries;
+    ring->sqLocalTail = *ring->sqTail;
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // Register the provided buffer ring and fill it with every receive buffer.
+    ring->bufRing = mmap(NULL, URING_RECV_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->bufMemory = malloc((size_t)URING_RECV_BUFFERS * URING_RECV_BUFFER_SIZE);
+    if (ring->bufRing == MAP_FAILED || ring->bufMemory == NULL) {
+        if (ring->bufRing == MAP_FAILED) {
+            ring->bufRing = NULL;
+        }
+        udpUringClose(ring);
+        return -1;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->bufRing;
+    reg.ring_entries = URING_RECV_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ring->ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        udpUringClose(ring);
+        return -1;
+    }
+    for (unsigned bid = 0; bid < URING_RECV_BUFFERS; bid++) {
+        udpUringRecycle(ring, bid);
+    }
+    __atomic_store_n(&ring->bufRing->tail, (uint16_t)ring->bufTail, __ATOMIC_RELEASE);
+
+    // The multishot receive only uses the name and control lengths of this header.
+    memset(&ring->recvMsg, 0, sizeof(ring->recvMsg));
+    ring->recvMsg.msg_namelen = sizeof(struct sockaddr_in);
+
+    ring->sends = calloc(URING_SEND_SLOTS, sizeof(UdpUringSend));
+    ring->freeSends = malloc(URING_SEND_SLOTS * sizeof(int));
+    if (ring->sends == NULL || ring->freeSends == NULL) {
+        udpUringClose(ring);
+        return -1;
+    }
+    for (int i = 0; i < URING_SEND_SLOTS; i++) {
+        ring->freeSends[ring->freeCount++] = URING_SEND_SLOTS - 1 - i;
+    }
+    return 0;
+}
+
+// Handle one completion. Returns -1 on a fatal receive error.
+static inline int udpUringComplete(UdpUring *ring, struct io_uring_cqe *cqe, UdpUringHandler handler, void *context) {
+    if (cqe->user_data != URING_RECV_TAG) {
+        // A send finished; its slot can be reused.
+        ring->freeSends[ring->freeCount++] = (int)cqe->user_data;
+        return 0;
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        ring->recvArmed = 0;
+    }
+    if (cqe->res < 0) {
+        // Running out of buffers only stops the multishot request; it is re-armed after the batch.
+        return (cqe->res == -ENOBUFS || cqe->res == -EINTR) ? 0 : -1;
+    }
+    if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+        return 0;
+    }
+
+    unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    unsigned char *buffer = ring->bufMemory + (size_t)bid * URING_RECV_BUFFER_SIZE;
+    struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buffer;
+    unsigned char *name = buffer + sizeof(*out);
+    unsigned char *payload = name + ring->recvMsg.msg_namelen + ring->recvMsg.msg_controllen;
+    size_t room = URING_RECV_BUFFER_SIZE - (size_t)(payload - buffer);
+    int len = out->payloadlen < room ? (int)out->payloadlen : (int)room;
+
+    if (!(out->flags & MSG_TRUNC)) {
+        struct sockaddr_in from;
+        memcpy(&from, name, sizeof(from));
+        ring->packets++;
+        handler(ring, context, payload, len, &from);
+    }
+    udpUringRecycle(ring, bid);
+    return 0;
+}
+
+// Receive and answer packets until *stop becomes non-zero.
+// Returns 0 when stopped, -1 on a fatal error.
+static inline int udpUringRun(UdpUring *ring, UdpUringHandler handler, void *context, volatile sig_atomic_t *stop) {
+    int spins = 0;
+    while (!*stop) {
+        if (!ring->recvArmed && udpUringArmRecv(ring) < 0) {
+            return -1;
+        }
+
+        // Reap every completion that is ready.
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        unsigned reaped = tail - head;
+        while (head != tail) {
+            if (udpUringComplete(ring, &ring->cqes[head & *ring->cqMask], handler, context) < 0) {
+                return -1;
+            }
+            head++;
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+        __atomic_store_n(&ring->bufRing->tail, (uint16_t)ring->bufTail, __ATOMIC_RELEASE);
+        if (!ring->recvArmed && udpUringArmRecv(ring) < 0) {
+            return -1;
+        }
+
+        // Submit the responses and wait for more work in a single call.
+        unsigned pending = udpUringPublish(ring);
+        if (ring->sqpoll) {
+            if (pending > 0 && (__atomic_load_n(ring->sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP)) {
+                udpUringEnter(ring, 0, 0, IORING_ENTER_SQ_WAKEUP);
+            }
+            // The kernel thread submits for us; only sleep once the queue has stayed empty for a while.
+            if (reaped > 0 || ++spins < URING_SPIN_LOOPS) {
+                if (reaped > 0) {
+                    spins = 0;
+                }
+                continue;
+            }
+            spins = 0;
+            udpUringEnter(ring, 0, 1, IORING_ENTER_GETEVENTS);
+        } else {
+            udpUringEnter(ring, pending, 1, IORING_ENTER_GETEVENTS);
+        }
+    }
+    return 0;
+}
+
+#else
+
+// io_uring is not available on this system; udpUringInit() always fails.
+typedef struct UdpUring {
+    long packets;
+    long responses;
+    long sendDrops;
+    long syscalls;
+} UdpUring;
+
+typedef void (*UdpUringHandler)(UdpUring *ring, void *context, void *packet, int len, struct sockaddr_in *from);
+
+static inline int udpUringInit(UdpUring *ring, int sockfd, int sqpoll) {
+    (void)sockfd;
+    (void)sqpoll;
+    memset(ring, 0, sizeof(*ring));
+    return -1;
+}
+
+static inline int udpUringReserve(UdpUring *ring, int count) {
+    ring->sendDrops += count;
+    return -1;
+}
+
+static inline int udpUringSend(UdpUring *ring, const void *data, int len, const struct sockaddr_in *to, int linkNext) {
+    (void)data;
+    (void)len;
+    (void)to;
+    (void)linkNext;
+    ring->sendDrops++;
+    return -1;
+}
+
+static inline int udpUringRun(UdpUring *ring, UdpUringHandler handler, void *context, volatile sig_atomic_t *stop) {
+    (void)ring;
+    (void)handler;
+    (void)context;
+    (void)stop;
+    return -1;
+}
+
+static inline void udpUringClose(UdpUring *ring) {
+    (void)ring;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,95 @@
+#!/bin/sh
+# -----------------------------------------------------------------------------
+# Server I/O Engine Comparison
+# -----------------------------------------------------------------------------
+#
+# Runs both servers with each I/O engine (classic recvfrom/sendto, io_uring, and
+# io_uring with SQPOLL) under the same udp_loadgen load, and prints responses per
+# second together with the syscalls per packet the server counted. The kernel
+# version is printed first, since the best engine depends on it.
+#
+# Each run waits for the previous server's socket to be released and for the new
+# server to bind the port before loading it (the servers do not check bind(), and
+# an io_uring server's socket can be closed a little after the process exits). A
+# run that gets no response is reported as an error, and the script exits with 1.
+#
+# Usage: ./bench_backends.sh [seconds] [window]
+
+set -u
+
+SECONDS_PER_RUN=${1:-5}
+WINDOW=${2:-256}
+PORT=${PORT:-18091}
+WAIT_TRIES=50                       # Port checks 0.1s apart before giving up.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+
+gcc -O2 -o "$BUILD/loadgen" "$ROOT/Tools/udp_loadgen.c" || exit 1
+gcc -O2 -o "$BUILD/a1_server" "$ROOT/Assignment_1/server.c" || exit 1
+gcc -O2 -pthread -o "$BUILD/a2_server" "$ROOT/Assignment_2/server.c" || exit 1
+
+# Succeed if a UDP socket is bound to $PORT (local address column of /proc/net/udp).
+port_bound() {
+    awk -v port="$(printf ':%04X' "$PORT")" 'NR > 1 && substr($2, length($2) - 4) == port { found = 1 }
+        END { exit !found }' /proc/net/udp
+}
+
+# Wait until port_bound returns $1 (0 = bound, 1 = free); fail after WAIT_TRIES checks.
+wait_port() {
+    tries=0
+    while :; do
+        port_bound
+        [ $? -eq "$1" ] && return 0
+        tries=$((tries + 1))
+        [ "$tries" -ge "$WAIT_TRIES" ] && return 1
+        sleep 0.1
+    done
+}
+
+status=0
+
+echo "kernel: $(uname -sr)"
+printf "%-6s %-14s %18s %18s\n" server engine responses_per_sec syscalls_per_pkt
+
+for server in a1 a2; do
+    case $server in
+        a1) dir=Assignment_1 ;;
+        a2) dir=Assignment_2 ;;
+    esac
+    for engine in classic uring uring-sqpoll; do
+        cd "$ROOT/$dir" || exit 1
+        if ! wait_port 1; then
+            echo "ERROR - port $PORT is still in use, skipping $server $engine" >&2
+            status=1
+            continue
+        fi
+        "$BUILD/${server}_server" -q -e "$engine" -p "$PORT" > "$BUILD/server.log" 2>&1 &
+        server_pid=$!
+        if ! wait_port 0 || ! kill -0 "$server_pid" 2>/dev/null; then
+            echo "ERROR - $server $engine server did not bind port $PORT" >&2
+            kill -INT "$server_pid" 2>/dev/null
+            wait "$server_pid"
+            status=1
+            continue
+        fi
+        result=$("$BUILD/loadgen" -m "$server" -p "$PORT" -d "$SECONDS_PER_RUN" -w "$WINDOW")
+        rate=$(echo "$result" | sed -n 's/.*responses_per_sec=\([0-9]*\).*/\1/p')
+        received=$(echo "$result" | sed -n 's/.* received=\([0-9]*\).*/\1/p')
+        kill -INT "$server_pid"
+        wait "$server_pid"
+        per_packet=$(sed -n 's/.*(\([0-9.]*\) per packet).*/\1/p' "$BUILD/server.log")
+        if grep -q "IO_URING IS NOT AVAILABLE" "$BUILD/server.log"; then
+            engine="$engine(n/a)"
+        fi
+        if [ "${received:-0}" -eq 0 ]; then
+            echo "ERROR - $server $engine got no responses, not a result" >&2
+            status=1
+            continue
+        fi
+        printf "%-6s %-14s %18s %18s\n" "$server" "$engine" "$rate" "$per_packet"
+    done
+done
+
+exit $status
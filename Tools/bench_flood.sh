@@ -0,0 +1,56 @@
+#!/bin/sh
+# -----------------------------------------------------------------------------
+# Flood Protection Benchmark
+# -----------------------------------------------------------------------------
+#
+# Measures how many requests per second Assignment_2/server answers on its own,
+# then floods it at a multiple of that rate (10x by default) with flood_bench
+# and compares the legitimate client's latency and loss with and without the
+# server's rate limiter and cookie challenge. A third phase (spoofed-victim) adds a
+# flood from the legitimate client's own address. flood_pps shows the flood rate that
+# was actually reached; on a machine with few cores the generator competes with
+# the server for CPU, so it may stay below the target.
+#
+# Usage: ./bench_flood.sh [seconds] [multiplier]
+
+set -u
+
+SECONDS_PER_RUN=${1:-5}
+MULTIPLIER=${2:-10}
+PORT=${PORT:-18095}
+LEGIT_RATE=${LEGIT_RATE:-50}
+GUARD=${GUARD:-"-s 100 -c 2000"}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+
+gcc -O2 -o "$BUILD/loadgen" "$ROOT/Tools/udp_loadgen.c" || exit 1
+gcc -O2 -pthread -o "$BUILD/flood_bench" "$ROOT/Tools/flood_bench.c" || exit 1
+gcc -O2 -pthread -o "$BUILD/a2_server" "$ROOT/Assignment_2/server.c" || exit 1
+cd "$ROOT/Assignment_2" || exit 1
+
+# Capacity of the unprotected server.
+"$BUILD/a2_server" -q -p "$PORT" > "$BUILD/server.log" 2>&1 &
+server_pid=$!
+sleep 0.3
+capacity=$("$BUILD/loadgen" -m a2 -p "$PORT" -d 2 | sed -n 's/.*responses_per_sec=\([0-9]*\).*/\1/p')
+kill -INT "$server_pid"
+wait "$server_pid"
+flood_rate=$((capacity * MULTIPLIER))
+echo "capacity: $capacity requests/s, flood target: $flood_rate requests/s"
+
+# name|server options
+for config in "unprotected|" "guard|$GUARD" "guard-uring|-e uring $GUARD"; do
+    name=${config%%|*}
+    options=${config#*|}
+    # shellcheck disable=SC2086
+    "$BUILD/a2_server" -q -p "$PORT" $options > "$BUILD/server.log" 2>&1 &
+    server_pid=$!
+    sleep 0.3
+    echo "== $name ($options)"
+    "$BUILD/flood_bench" -p "$PORT" -d "$SECONDS_PER_RUN" -r "$LEGIT_RATE" -f "$flood_rate" -t 2 -v
+    kill -INT "$server_pid"
+    wait "$server_pid"
+    grep "drops" "$BUILD/server.log"
+done
@@ -0,0 +1,48 @@
+#!/bin/sh
+# -----------------------------------------------------------------------------
+# UDP GSO/GRO Loopback Benchmark
+# -----------------------------------------------------------------------------
+#
+# Runs the Assignment_1 server (classic engine) with and without UDP GRO, loaded by
+# udp_loadgen with and without UDP GSO, and prints the packets per second the server
+# handled together with its syscalls per packet.
+#
+# Usage: ./bench_gso.sh [seconds] [window]
+
+set -u
+
+SECONDS_PER_RUN=${1:-5}
+WINDOW=${2:-512}
+PORT=${PORT:-18092}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+
+gcc -O2 -o "$BUILD/loadgen" "$ROOT/Tools/udp_loadgen.c" || exit 1
+gcc -O2 -o "$BUILD/server" "$ROOT/Assignment_1/server.c" || exit 1
+
+echo "kernel: $(uname -sr)"
+printf "%-10s %-10s %16s %18s %18s\n" sender receiver server_pkts_per_s responses_per_s syscalls_per_pkt
+
+for gso in off on; do
+    for gro in off on; do
+        server_flags="-q"
+        loadgen_flags=""
+        [ "$gro" = on ] && server_flags="$server_flags -g"
+        [ "$gso" = on ] && loadgen_flags="-g"
+
+        cd "$ROOT/Assignment_1" || exit 1
+        "$BUILD/server" $server_flags -p "$PORT" > "$BUILD/server.log" 2>&1 &
+        server_pid=$!
+        sleep 0.3
+        rate=$("$BUILD/loadgen" -m a1 $loadgen_flags -p "$PORT" -d "$SECONDS_PER_RUN" -w "$WINDOW" |
+            sed -n 's/.*responses_per_sec=\([0-9]*\).*/\1/p')
+        kill -INT "$server_pid"
+        wait "$server_pid"
+        packets=$(sed -n 's/.*Packets: \([0-9]*\).*/\1/p' "$BUILD/server.log")
+        per_packet=$(sed -n 's/.*(\([0-9.]*\) per packet).*/\1/p' "$BUILD/server.log")
+        pps=$(awk -v p="${packets:-0}" -v s="$SECONDS_PER_RUN" 'BEGIN { printf "%.0f", p / s }')
+        printf "%-10s %-10s %16s %18s %18s\n" "gso-$gso" "gro-$gro" "$pps" "$rate" "$per_packet"
+    done
+done
@@ -0,0 +1,113 @@
+#!/bin/sh
+# -----------------------------------------------------------------------------
+# Impairment Benchmark Matrix
+# -----------------------------------------------------------------------------
+#
+# Runs every protocol through every impairment profile of impair_proxy and records
+# the completion time of each client run. A fresh server and proxy are started for
+# every run (the Assignment_1 server keeps sequence state between clients), and run
+# number N uses proxy seed SEED+N, so the whole matrix is reproducible.
+#
+# Usage: ./bench_matrix.sh [runs] [seed] [profiles...]
+# Output: bench_results.csv with one line per run, and a summary per protocol/profile
+#         with completion-time percentiles and goodput (payload bytes per second).
+#
+# Protocols:
+#   a1      Assignment_1 stop-and-wait data packets (client -c, no simulated errors)
+#   a1-fec  Assignment_1 with FEC blocks of 4 data + 2 repair packets
+#   a2      Assignment_2 subscriber permission requests
+
+set -u
+
+RUNS=${1:-5}
+SEED=${2:-1}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] && shift
+PROFILES=${*:-"clean lossy bursty reorder wan congested hostile"}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$(mktemp -d)
+RESULTS=${RESULTS:-bench_results.csv}
+SERVER_PORT=${SERVER_PORT:-18081}
+PROXY_PORT=${PROXY_PORT:-19081}
+
+cleanup() {
+    rm -rf "$BUILD"
+}
+trap cleanup EXIT
+
+gcc -O2 -o "$BUILD/proxy" "$ROOT/Tools/impair_proxy.c" || exit 1
+gcc -O2 -o "$BUILD/a1_server" "$ROOT/Assignment_1/server.c" || exit 1
+gcc -O2 -o "$BUILD/a1_client" "$ROOT/Assignment_1/client.c" || exit 1
+gcc -O2 -pthread -o "$BUILD/a2_server" "$ROOT/Assignment_2/server.c" || exit 1
+gcc -O2 -o "$BUILD/a2_client" "$ROOT/Assignment_2/client.c" || exit 1
+
+now_ms() {
+    date +%s%3N
+}
+
+# Payload bytes each protocol delivers in one client run.
+payload_bytes() {
+    case $1 in
+        a1*) head -n 10 "$ROOT/Assignment_1/payload.txt" | wc -c ;;
+        a2) head -n 5 "$ROOT/Assignment_2/payload.txt" | wc -c ;;
+    esac
+}
+
+run_one() {
+    protocol=$1
+    profile=$2
+    seed=$3
+    case $protocol in
+        a1) dir=Assignment_1; server=a1_server; client="a1_client -c" ;;
+        a1-fec) dir=Assignment_1; server=a1_server; client="a1_client -c -k 4 -m 2" ;;
+        a2) dir=Assignment_2; server=a2_server; client="a2_client" ;;
+    esac
+
+    cd "$ROOT/$dir" || exit 1
+    "$BUILD/$server" -p "$SERVER_PORT" > /dev/null 2>&1 &
+    server_pid=$!
+    "$BUILD/proxy" -l "$PROXY_PORT" -u "$SERVER_PORT" -P "$profile" -s "$seed" > "$BUILD/proxy.log" 2>&1 &
+    proxy_pid=$!
+    sleep 0.2
+
+    start=$(now_ms)
+    $BUILD/$client -p "$PROXY_PORT" > "$BUILD/client.log" 2>&1
+    end=$(now_ms)
+
+    if grep -q "SERVER NOT RESPONDING" "$BUILD/client.log"; then
+        status=failed
+    else
+        status=ok
+    fi
+
+    kill "$proxy_pid" "$server_pid" 2>/dev/null
+    wait "$proxy_pid" "$server_pid" 2>/dev/null
+    echo "$protocol,$profile,$seed,$((end - start)),$status,$(payload_bytes "$protocol")" >> "$RESULTS"
+}
+
+echo "protocol,profile,seed,completion_ms,status,payload_bytes" > "$RESULTS"
+for profile in $PROFILES; do
+    for protocol in a1 a1-fec a2; do
+        run=1
+        while [ "$run" -le "$RUNS" ]; do
+            run_one "$protocol" "$profile" $((SEED + run))
+            run=$((run + 1))
+        done
+    done
+done
+
+# Summary: completion-time percentiles and mean goodput per protocol and profile.
+printf "\n%-8s %-10s %5s %8s %8s %8s %8s %12s\n" protocol profile runs failed p50_ms p90_ms max_ms goodput_B/s
+tail -n +2 "$RESULTS" | sort -t, -k1,1 -k2,2 -k4,4n | awk -F, '
+function report() {
+    if (n == 0) return
+    printf "%-8s %-10s %5d %8d %8d %8d %8d %12.1f\n", key1, key2, n, failed,
+        t[int((n - 1) * 0.5) + 1], t[int((n - 1) * 0.9) + 1], t[n], (total > 0 ? bytes / (total / 1000.0) : 0)
+}
+{
+    if ($1 != key1 || $2 != key2) { report(); key1 = $1; key2 = $2; n = 0; failed = 0; total = 0; bytes = 0 }
+    t[++n] = $4; total += $4; bytes += $6
+    if ($5 != "ok") failed++
+}
+END { report() }'
@@ -0,0 +1,352 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// -----------------------------------------------------------------------------
+// Flood Benchmark for the Authentication Server
+// -----------------------------------------------------------------------------
+//
+// Measures the latency a legitimate client sees from Assignment_2/server, first
+// on its own and then while flood threads send access permission requests from
+// many other loopback addresses (127.0.0.2 and up, standing in for spoofed
+// sources). The legitimate client sends at a fixed rate from 127.0.0.1 and answers
+// cookie challenges like the real client does. The flood never reads its cookie
+// challenges, just as a spoofer never sees them.
+//
+// With -v a third phase adds a spoofer: one more flood thread that sends from the
+// legitimate client's own address (127.0.0.1, other ports), starting after
+// SPOOF_DELAY_MS so the client has already been given a cookie. The legitimate
+// client should see no extra loss, because its cookied requests do not share a
+// rate limit with requests that merely claim its address.
+//
+// For each phase the tool prints the legitimate p50/p99/p99.9 latency and loss,
+// the flood rate it managed to send, and how many flood requests were answered
+// with a lookup result instead of being dropped or challenged.
+//
+// Compile: gcc -O2 -pthread flood_bench.c -o flood_bench
+// Run:     ./flood_bench -p 8081 -d 5 -r 200 -f 2000000 -t 4 [-v]
+
+#define BATCH 64                      // Flood datagrams per sendmmsg() call.
+#define LEGIT_TIMEOUT_MS 1000         // A legitimate request unanswered this long is counted as lost.
+#define MAX_TAGS 65536                // Outstanding legitimate requests are identified by client_id and seg_no.
+#define SPOOF_DELAY_MS 1000           // The spoofer starts this long into its phase.
+#define LEGIT_HOST 1                  // The legitimate client sends from 127.0.0.1.
+
+#define ACCESS_PERM 0XFFF8
+#define COOKIE_CHALLENGE 0XFFFC
+
+// Same layout as the PermissionPacket in Assignment_2.
+typedef struct PermissionPacket{
+    uint16_t start_packet_identifier;
+    uint8_t client_id;
+    uint16_t permission;
+    uint8_t seg_no;
+    uint8_t plen;
+    uint8_t technology;
+    unsigned long src_sub_no;
+    uint16_t end_packet_identifier;
+    uint32_t cookie;
+} PermissionPacket;
+
+typedef struct FloodThread {
+    pthread_t thread;
+    int firstSource;                  // Sources firstSource .. firstSource + sourceCount - 1 belong to this thread.
+    int sourceCount;
+    double rate;                      // Requests per second for this thread, 0 = as fast as possible.
+    int delayMs;                      // Wait this long before sending.
+    long sent;
+    long answered;                    // Lookup answers that reached the flood sockets.
+} FloodThread;
+
+static int serverPort = 8081;
+static atomic_int floodRunning;
+
+static uint64_t nowNs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fillRequest(PermissionPacket *packet, unsigned long subscriber){
+    memset(packet, 0, sizeof(*packet));
+    packet->start_packet_identifier = 0XFFFF;
+    packet->client_id = 0XFF;
+    packet->permission = ACCESS_PERM;
+    packet->seg_no = 1;
+    packet->plen = 11;
+    packet->technology = 4;
+    packet->src_sub_no = subscriber;
+    packet->end_packet_identifier = 0XFFFF;
+}
+
+// UDP socket bound to 127.0.0.<host> and connected to the server.
+static int openSocket(int host){
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address;
+    bzero(&address, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(0x7F000000u | (unsigned)host);
+    if(sockfd < 0 || bind(sockfd, (struct sockaddr *)&address, sizeof(address)) < 0){
+        return -1;
+    }
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(serverPort);
+    if(connect(sockfd, (struct sockaddr *)&address, sizeof(address)) < 0){
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+static void *floodMain(void *arg){
+    FloodThread *flood = arg;
+    int sockets[256];
+    int count = flood->sourceCount < 256 ? flood->sourceCount : 256;
+    for(int i = 0; i < count; i++){
+        sockets[i] = openSocket(flood->firstSource + i);
+        if(sockets[i] < 0){
+            printf("\nERROR - COULD NOT BIND FLOOD SOURCE 127.0.0.%d.\n", flood->firstSource + i);
+            return NULL;
+        }
+    }
+
+    // Requests for random subscribers, which defeats any per-subscriber limit on its own.
+    PermissionPacket requests[BATCH];
+    struct mmsghdr msgs[BATCH];
+    struct iovec iovs[BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    uint64_t seed = nowNs() ^ (uint64_t)flood->firstSource;
+    for(int i = 0; i < BATCH; i++){
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        fillRequest(&requests[i], 5000000000UL + (seed >> 33) % 100000000UL);
+        iovs[i].iov_base = &requests[i];
+        iovs[i].iov_len = sizeof(PermissionPacket);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    PermissionPacket response;
+    uint64_t start = nowNs() + (uint64_t)flood->delayMs * 1000000ULL;
+    while(atomic_load(&floodRunning) && nowNs() < start){
+        struct timespec pause = {0, 1000000};
+        nanosleep(&pause, NULL);
+    }
+    int next = 0;
+    while(atomic_load(&floodRunning)){
+        if(flood->rate > 0){
+            uint64_t due = start + (uint64_t)(flood->sent / flood->rate * 1e9);
+            uint64_t now = nowNs();
+            if(due > now){
+                struct timespec pause = {0, (long)((due - now) < 1000000 ? (due - now) : 1000000)};
+                nanosleep(&pause, NULL);
+                continue;
+            }
+        }
+        int done = sendmmsg(sockets[next], msgs, BATCH, MSG_DONTWAIT);
+        if(done > 0){
+            flood->sent += done;
+        }
+
+        // Drain what came back so the socket buffers do not fill up; count real answers.
+        while(recv(sockets[next], &response, sizeof(response), MSG_DONTWAIT) > 0){
+            if(response.permission != COOKIE_CHALLENGE){
+                flood->answered++;
+            }
+        }
+        next = (next + 1) % count;
+    }
+    for(int i = 0; i < count; i++){
+        close(sockets[i]);
+    }
+    return NULL;
+}
+
+static int compareDouble(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Run one phase. Returns 0 on success.
+// With spoof set, one extra flood thread sends from the legitimate client's address.
+static int runPhase(const char *name, double seconds, double legitRate, int floodThreads, double floodRate, int floodSources,
+                    int spoof){
+    int sockfd = openSocket(LEGIT_HOST);
+    if(sockfd < 0){
+        printf("\nERROR - COULD NOT CONNECT TO PORT %d.\n", serverPort);
+        return -1;
+    }
+
+    FloodThread floods[65];
+    if(floodThreads > 64){
+        floodThreads = 64;
+    }
+    int regularThreads = floodThreads;
+    atomic_store(&floodRunning, 1);
+    for(int i = 0; i < floodThreads; i++){
+        memset(&floods[i], 0, sizeof(floods[i]));
+        floods[i].sourceCount = floodSources / floodThreads > 0 ? floodSources / floodThreads : 1;
+        floods[i].firstSource = 2 + i * floods[i].sourceCount;
+        floods[i].rate = floodRate / floodThreads;
+        pthread_create(&floods[i].thread, NULL, floodMain, &floods[i]);
+    }
+    if(spoof && regularThreads > 0){
+        FloodThread *spoofer = &floods[floodThreads++];
+        memset(spoofer, 0, sizeof(*spoofer));
+        spoofer->firstSource = LEGIT_HOST;
+        spoofer->sourceCount = 1;
+        spoofer->rate = floodRate / regularThreads;
+        spoofer->delayMs = SPOOF_DELAY_MS;
+        pthread_create(&spoofer->thread, NULL, floodMain, spoofer);
+    }
+
+    static uint64_t sentAt[MAX_TAGS];
+    static double latency[1 << 20];
+    memset(sentAt, 0, sizeof(sentAt));
+    long legitSent = 0, answered = 0, challenged = 0, lost = 0;
+    uint32_t cookie = 0;
+    PermissionPacket request, response;
+
+    uint64_t start = nowNs();
+    uint64_t end = start + (uint64_t)(seconds * 1e9);
+    uint64_t interval = (uint64_t)(1e9 / legitRate);
+    uint64_t nextSend = start;
+    uint64_t now = start;
+    long lossWindow = (long)(legitRate * LEGIT_TIMEOUT_MS / 1000) * 2 + 16;
+    if(lossWindow > MAX_TAGS){
+        lossWindow = MAX_TAGS;
+    }
+
+    while(now < end){
+        if(now >= nextSend){
+            uint16_t tag = (uint16_t)legitSent;
+            if(sentAt[tag] != 0){
+                lost++;
+            }
+            fillRequest(&request, 5000000000UL + legitSent % 1000);
+            request.client_id = tag >> 8;
+            request.seg_no = tag & 0xFF;
+            request.cookie = cookie;
+            sentAt[tag] = now;
+            send(sockfd, &request, sizeof(request), 0);
+            legitSent++;
+            nextSend += interval;
+        }
+
+        int waitMs = (int)((nextSend > now ? nextSend - now : 0) / 1000000);
+        struct pollfd pfd = {sockfd, POLLIN, 0};
+        if(poll(&pfd, 1, waitMs) > 0){
+            while(recv(sockfd, &response, sizeof(response), MSG_DONTWAIT) > 0){
+                uint16_t tag = (uint16_t)(response.client_id << 8 | response.seg_no);
+                if(sentAt[tag] == 0){
+                    continue;
+                }
+                if(response.permission == COOKIE_CHALLENGE){
+                    // Resend the same request with the cookie; latency still counts from the first send.
+                    cookie = response.cookie;
+                    challenged++;
+                    fillRequest(&request, response.src_sub_no);
+                    request.client_id = response.client_id;
+                    request.seg_no = response.seg_no;
+                    request.cookie = cookie;
+                    send(sockfd, &request, sizeof(request), 0);
+                    continue;
+                }
+                if(answered < (long)(sizeof(latency) / sizeof(latency[0]))){
+                    latency[answered] = (nowNs() - sentAt[tag]) / 1e3;
+                }
+                answered++;
+                sentAt[tag] = 0;
+            }
+        }
+        now = nowNs();
+
+        // Requests that were never answered. Older ones are caught when their tag is reused.
+        for(long i = legitSent - lossWindow; i < legitSent; i++){
+            uint16_t tag = (uint16_t)i;
+            if(i >= 0 && sentAt[tag] != 0 && now - sentAt[tag] > LEGIT_TIMEOUT_MS * 1000000ULL){
+                sentAt[tag] = 0;
+                lost++;
+            }
+        }
+    }
+
+    atomic_store(&floodRunning, 0);
+    long floodSent = 0, floodAnswered = 0;
+    for(int i = 0; i < floodThreads; i++){
+        pthread_join(floods[i].thread, NULL);
+        floodSent += floods[i].sent;
+        floodAnswered += floods[i].answered;
+    }
+    close(sockfd);
+
+    double elapsed = (nowNs() - start) / 1e9;
+    long samples = answered < (long)(sizeof(latency) / sizeof(latency[0])) ? answered : (long)(sizeof(latency) / sizeof(latency[0]));
+    qsort(latency, samples, sizeof(double), compareDouble);
+    double p50 = samples > 0 ? latency[samples / 2] : 0;
+    double p99 = samples > 0 ? latency[(long)(samples * 0.99)] : 0;
+    double p999 = samples > 0 ? latency[(long)(samples * 0.999)] : 0;
+    printf("phase=%s legit_sent=%ld answered=%ld lost=%ld pending=%ld challenged=%ld p50_us=%.1f p99_us=%.1f p999_us=%.1f flood_pps=%.0f flood_answered=%ld\n",
+           name, legitSent, answered, lost, legitSent - answered - lost, challenged, p50, p99, p999, floodSent / elapsed, floodAnswered);
+    return 0;
+}
+
+int main(int argc, char *argv[]){
+    double duration = 5;
+    double legitRate = 200;
+    double floodRate = 0;
+    int floodThreads = 2;
+    int floodSources = 64;
+    int spoof = 0;
+    int option;
+
+    while((option = getopt(argc, argv, "p:d:r:f:t:n:v")) != -1){
+        if(option == 'p'){
+            serverPort = atoi(optarg);
+        }else if(option == 'd'){
+            duration = atof(optarg);
+        }else if(option == 'r'){
+            legitRate = atof(optarg);
+        }else if(option == 'f'){
+            floodRate = atof(optarg);
+        }else if(option == 't'){
+            floodThreads = atoi(optarg);
+        }else if(option == 'n'){
+            floodSources = atoi(optarg);
+        }else if(option == 'v'){
+            spoof = 1;
+        }else{
+            printf("Usage: %s [-p port] [-d seconds] [-r legit_rate] [-f flood_rate] [-t flood_threads] [-n flood_sources] [-v]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(legitRate <= 0 || floodThreads <= 0 || floodSources <= 0 || floodSources > 250){
+        printf("Usage: %s [-p port] [-d seconds] [-r legit_rate] [-f flood_rate] [-t flood_threads] [-n flood_sources] [-v]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    if(runPhase("baseline", duration, legitRate, 0, 0, floodSources, 0) < 0){
+        return 1;
+    }
+    if(runPhase("flood", duration, legitRate, floodThreads, floodRate, floodSources, 0) < 0){
+        return 1;
+    }
+    if(spoof && runPhase("spoofed-victim", duration, legitRate, floodThreads, floodRate, floodSources, 1) < 0){
+        return 1;
+    }
+    return 0;
+}
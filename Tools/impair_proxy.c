@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// -----------------------------------------------------------------------------
+// UDP Network Impairment Proxy
+// -----------------------------------------------------------------------------
+//
+// Sits between a client and a server on localhost and forwards datagrams in both
+// directions, applying loss, burst loss, reordering, duplication, corruption,
+// delay/jitter and a bandwidth cap. Every decision comes from a seeded generator
+// (one per direction), so the same seed gives the same impairments for the same
+// sequence of packets.
+//
+// The client sends to the proxy's listen port; the proxy forwards to the server
+// port and sends the server's answers back to the last client it heard from.
+//
+// Compile: gcc -O2 impair_proxy.c -o impair_proxy
+// Run:     ./impair_proxy -l 9081 -u 8081 -P wan -s 7
+//
+// Statistics are printed when the proxy receives SIGINT or SIGTERM.
+
+#define MAX_DATAGRAM 2048             // Largest datagram the proxy will forward.
+#define MAX_PENDING 4096              // Datagrams that can wait in the delay queue at once.
+
+#define UPSTREAM 0                    // Client to server direction.
+#define DOWNSTREAM 1                  // Server to client direction.
+
+// Impairments applied to each direction. Percentages are 0-100, times are milliseconds.
+typedef struct ImpairProfile{
+    const char *name;
+    double loss;                      // Independent loss probability.
+    double burstStart;                // Probability of entering a loss burst (Gilbert-Elliott model).
+    double burstLength;               // Mean number of datagrams lost per burst.
+    double reorder;                   // Probability that a datagram is held back and overtaken.
+    double reorderHold;               // Extra time a reordered datagram is held.
+    double duplicate;                 // Probability that a datagram is delivered twice.
+    double corrupt;                   // Probability that one byte of a datagram is flipped.
+    double delay;                     // Fixed one-way delay.
+    double jitter;                    // Extra delay drawn uniformly from [0, jitter].
+    double bandwidth;                 // Link rate in kbit/s, 0 for unlimited.
+} ImpairProfile;
+
+// Built-in profiles, selected with -P. Individual options given after -P override its values.
+static const ImpairProfile profiles[] = {
+    {"clean",     0,   0,   0,  0,  0,  0,   0,   0,  0,     0},
+    {"lossy",     2,   0,   0,  0,  0,  0,   0,   0,  0,     0},
+    {"bursty",    0,   1,   4,  0,  0,  0,   0,   0,  0,     0},
+    {"reorder",   0,   0,   0, 10,  5,  0,   0,   1,  0,     0},
+    {"wan",     0.5,   0,   0,  0,  0,  0,   0,  20,  5,     0},
+    {"congested", 1,   0,   0,  0,  0,  0,   0,  10,  2,   256},
+    {"hostile",   5, 0.5,   3,  5,  5,  2,   1,   5, 10,     0},
+};
+
+// Per-direction generator, link and counters.
+typedef struct Direction{
+    uint64_t rng;                     // xorshift64 state.
+    int inBurst;                      // Gilbert-Elliott state: 1 while a loss burst is in progress.
+    uint64_t linkFree;                // Time at which the bandwidth-capped link becomes idle.
+    long received;
+    long lost;
+    long burstLost;
+    long reordered;
+    long duplicated;
+    long corrupted;
+    long queueDrops;
+    long delivered;
+} Direction;
+
+// A datagram waiting in the delay queue.
+typedef struct Pending{
+    uint64_t release;                 // Time at which the datagram is sent on.
+    uint64_t order;                   // Arrival order, used to keep FIFO order between equal release times.
+    int direction;
+    int len;
+    unsigned char data[MAX_DATAGRAM];
+} Pending;
+
+// Min-heap of pending datagrams ordered by release time.
+typedef struct DelayQueue{
+    Pending *items[MAX_PENDING];
+    int count;
+    uint64_t nextOrder;
+} DelayQueue;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int signo){
+    (void)signo;
+    stopRequested = 1;
+}
+
+static uint64_t nowNs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double nextRandom(Direction *dir){
+    dir->rng ^= dir->rng << 13;
+    dir->rng ^= dir->rng >> 7;
+    dir->rng ^= dir->rng << 17;
+    return (dir->rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int chance(Direction *dir, double percent){
+    return percent > 0 && nextRandom(dir) * 100.0 < percent;
+}
+
+static int earlier(const Pending *a, const Pending *b){
+    return a->release < b->release || (a->release == b->release && a->order < b->order);
+}
+
+static void queuePush(DelayQueue *queue, Pending *item){
+    int i = queue->count++;
+    item->order = queue->nextOrder++;
+    while(i > 0 && earlier(item, queue->items[(i - 1) / 2])){
+        queue->items[i] = queue->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue->items[i] = item;
+}
+
+static Pending *queuePop(DelayQueue *queue){
+    Pending *top = queue->items[0];
+    Pending *last = queue->items[--queue->count];
+    int i = 0;
+    while(2 * i + 1 < queue->count){
+        int child = 2 * i + 1;
+        if(child + 1 < queue->count && earlier(queue->items[child + 1], queue->items[child])){
+            child++;
+        }
+        if(!earlier(queue->items[child], last)){
+            break;
+        }
+        queue->items[i] = queue->items[child];
+        i = child;
+    }
+    queue->items[i] = last;
+    return top;
+}
+
+// Decide whether a datagram is lost. Returns 1 if it should be dropped.
+static int applyLoss(Direction *dir, const ImpairProfile *profile){
+    if(profile->burstStart > 0){
+        if(dir->inBurst){
+            // Leave the burst with probability 1/burstLength so bursts have the requested mean length.
+            if(nextRandom(dir) * profile->burstLength < 1.0){
+                dir->inBurst = 0;
+            }else{
+                dir->burstLost++;
+                return 1;
+            }
+        }else if(chance(dir, profile->burstStart)){
+            dir->inBurst = profile->burstLength > 1.0;
+            dir->burstLost++;
+            return 1;
+        }
+    }
+    if(chance(dir, profile->loss)){
+        dir->lost++;
+        return 1;
+    }
+    return 0;
+}
+
+// Queue one copy of a datagram, applying corruption, bandwidth, delay, jitter and reordering.
+static void schedule(DelayQueue *queue, Direction *dir, const ImpairProfile *profile, int direction,
+                     const unsigned char *data, int len, uint64_t now){
+    if(queue->count >= MAX_PENDING){
+        dir->queueDrops++;
+        return;
+    }
+    Pending *item = malloc(sizeof(Pending));
+    item->direction = direction;
+    item->len = len;
+    memcpy(item->data, data, len);
+
+    if(len > 0 && chance(dir, profile->corrupt)){
+        int offset = (int)(nextRandom(dir) * len);
+        item->data[offset] ^= (unsigned char)(1 + nextRandom(dir) * 255);
+        dir->corrupted++;
+    }
+
+    // Serialise onto the capped link, then add the propagation delay.
+    uint64_t departure = now;
+    if(profile->bandwidth > 0){
+        if(dir->linkFree > departure){
+            departure = dir->linkFree;
+        }
+        departure += (uint64_t)(len * 8.0 / (profile->bandwidth * 1000.0) * 1e9);
+        dir->linkFree = departure;
+    }
+    double delayMs = profile->delay + profile->jitter * nextRandom(dir);
+    if(chance(dir, profile->reorder)){
+        delayMs += profile->reorderHold;
+        dir->reordered++;
+    }
+    item->release = departure + (uint64_t)(delayMs * 1e6);
+    queuePush(queue, item);
+}
+
+static void printStats(const char *label, Direction *dir){
+    printf("%-10s received=%ld delivered=%ld lost=%ld burst_lost=%ld reordered=%ld duplicated=%ld corrupted=%ld queue_drops=%ld\n",
+           label, dir->received, dir->delivered, dir->lost, dir->burstLost, dir->reordered,
+           dir->duplicated, dir->corrupted, dir->queueDrops);
+}
+
+static void usage(const char *name){
+    printf("Usage: %s -l listen_port -u server_port [-P profile] [-s seed]\n"
+           "          [-L loss%%] [-G burst_start%%] [-B burst_length] [-R reorder%%] [-H reorder_hold_ms]\n"
+           "          [-D duplicate%%] [-C corrupt%%] [-d delay_ms] [-j jitter_ms] [-b kbit_per_s]\n"
+           "Profiles:", name);
+    for(size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++){
+        printf(" %s", profiles[i].name);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]){
+    ImpairProfile profile = profiles[0];
+    int listenPort = 0;
+    int serverPort = 0;
+    uint64_t seed = 1;
+    int option;
+
+    while((option = getopt(argc, argv, "l:u:P:s:L:G:B:R:H:D:C:d:j:b:")) != -1){
+        switch(option){
+        case 'l': listenPort = atoi(optarg); break;
+        case 'u': serverPort = atoi(optarg); break;
+        case 's': seed = strtoull(optarg, NULL, 10); break;
+        case 'L': profile.loss = atof(optarg); break;
+        case 'G': profile.burstStart = atof(optarg); break;
+        case 'B': profile.burstLength = atof(optarg); break;
+        case 'R': profile.reorder = atof(optarg); break;
+        case 'H': profile.reorderHold = atof(optarg); break;
+        case 'D': profile.duplicate = atof(optarg); break;
+        case 'C': profile.corrupt = atof(optarg); break;
+        case 'd': profile.delay = atof(optarg); break;
+        case 'j': profile.jitter = atof(optarg); break;
+        case 'b': profile.bandwidth = atof(optarg); break;
+        case 'P': {
+            size_t i;
+            for(i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++){
+                if(strcmp(profiles[i].name, optarg) == 0){
+                    profile = profiles[i];
+                    break;
+                }
+            }
+            if(i == sizeof(profiles) / sizeof(profiles[0])){
+                printf("\nERROR - UNKNOWN PROFILE %s.\n", optarg);
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(listenPort <= 0 || serverPort <= 0){
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Socket facing the client, bound to the listen port.
+    int clientSock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in listenAddress;
+    bzero(&listenAddress, sizeof(listenAddress));
+    listenAddress.sin_family = AF_INET;
+    listenAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listenAddress.sin_port = htons(listenPort);
+    if(clientSock < 0 || bind(clientSock, (struct sockaddr *)&listenAddress, sizeof(listenAddress)) < 0){
+        printf("\nERROR - COULD NOT BIND THE PROXY TO PORT %d.\n", listenPort);
+        return 1;
+    }
+
+    // Socket facing the server, connected so only the server's answers are accepted.
+    int serverSock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in serverAddress;
+    bzero(&serverAddress, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    serverAddress.sin_port = htons(serverPort);
+    if(serverSock < 0 || connect(serverSock, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0){
+        printf("\nERROR - COULD NOT CONNECT THE PROXY TO PORT %d.\n", serverPort);
+        return 1;
+    }
+    fcntl(clientSock, F_SETFL, O_NONBLOCK);
+    fcntl(serverSock, F_SETFL, O_NONBLOCK);
+
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    Direction directions[2];
+    memset(directions, 0, sizeof(directions));
+    directions[UPSTREAM].rng = seed * 0x9E3779B97F4A7C15ULL + 1;
+    directions[DOWNSTREAM].rng = seed * 0x9E3779B97F4A7C15ULL + 2;
+
+    DelayQueue *queue = calloc(1, sizeof(DelayQueue));
+    struct sockaddr_in clientAddress;
+    socklen_t clientAddrLen = 0;
+    unsigned char buffer[65536];
+
+    printf("Proxy 127.0.0.1:%d -> 127.0.0.1:%d, profile %s, seed %llu\n",
+           listenPort, serverPort, profile.name, (unsigned long long)seed);
+    fflush(stdout);
+
+    while(!stopRequested){
+        // Sleep until a datagram arrives or the next queued datagram is due.
+        int timeoutMs = -1;
+        if(queue->count > 0){
+            uint64_t now = nowNs();
+            uint64_t release = queue->items[0]->release;
+            timeoutMs = release > now ? (int)((release - now + 999999) / 1000000) : 0;
+        }
+        struct pollfd fds[2] = {{clientSock, POLLIN, 0}, {serverSock, POLLIN, 0}};
+        if(poll(fds, 2, timeoutMs) < 0 && errno != EINTR){
+            break;
+        }
+
+        // Read everything that has arrived in either direction.
+        for(int d = 0; d < 2; d++){
+            while(1){
+                struct sockaddr_in from;
+                socklen_t fromLen = sizeof(from);
+                int len = recvfrom(d == UPSTREAM ? clientSock : serverSock, buffer, sizeof(buffer), 0,
+                                   (struct sockaddr *)&from, &fromLen);
+                if(len < 0){
+                    break;
+                }
+                if(d == UPSTREAM){
+                    clientAddress = from;
+                    clientAddrLen = fromLen;
+                }
+                Direction *dir = &directions[d];
+                dir->received++;
+                if(len > MAX_DATAGRAM){
+                    dir->queueDrops++;
+                    continue;
+                }
+                if(applyLoss(dir, &profile)){
+                    continue;
+                }
+                uint64_t now = nowNs();
+                schedule(queue, dir, &profile, d, buffer, len, now);
+                if(chance(dir, profile.duplicate)){
+                    dir->duplicated++;
+                    schedule(queue, dir, &profile, d, buffer, len, now);
+                }
+            }
+        }
+
+        // Send on every datagram whose release time has passed.
+        uint64_t now = nowNs();
+        while(queue->count > 0 && queue->items[0]->release <= now){
+            Pending *item = queuePop(queue);
+            if(item->direction == UPSTREAM){
+                send(serverSock, item->data, item->len, 0);
+            }else if(clientAddrLen > 0){
+                sendto(clientSock, item->data, item->len, 0, (struct sockaddr *)&clientAddress, clientAddrLen);
+            }
+            directions[item->direction].delivered++;
+            free(item);
+        }
+    }
+
+    printStats("upstream", &directions[UPSTREAM]);
+    printStats("downstream", &directions[DOWNSTREAM]);
+    while(queue->count > 0){
+        free(queuePop(queue));
+    }
+    free(queue);
+    return 0;
+}
@@ -0,0 +1,252 @@
+// -----------------------------------------------------------------------------
+// Trace Replay
+// -----------------------------------------------------------------------------
+//
+// Replays a capture written by a server started with "-w FILE", in one of two ways:
+//
+// - Over loopback (-l PORT): every datagram is sent to 127.0.0.1:PORT with the
+//   original spacing, divided by the -x speed factor (-x 0 sends as fast as
+//   possible). Responses are counted.
+//
+// - Directly (no -l): the datagrams are fed to the server's own packet handler
+//   without any socket, -n times over, and the time per packet is reported.
+//   That is the pure validation/lookup cost, without network overhead. The server
+//   source is compiled into this tool for that, so build one binary per server:
+//
+//     gcc -O2 -DREPLAY_ASSIGNMENT_1 trace_replay.c -o replay_a1   (processPacket)
+//     gcc -O2 -DREPLAY_ASSIGNMENT_2 trace_replay.c -o replay_a2   (handlePermissionPacket)
+//     gcc -O2 trace_replay.c -o trace_replay                      (loopback only)
+//
+// replay_a2 loads Verification_Database.txt like the server does, so run it from
+// the Assignment_2 folder.
+//
+// Run: ./replay_a1 -n 1000 capture.trace
+//      ./trace_replay -l 8081 -x 10 capture.trace
+
+#define _GNU_SOURCE
+
+// The server's packet handling, without its main().
+#define SERVER_NO_MAIN
+#if defined(REPLAY_ASSIGNMENT_1)
+#include "../Assignment_1/server.c"
+#elif defined(REPLAY_ASSIGNMENT_2)
+#include "../Assignment_2/server.c"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../Common/udp_trace.h"
+
+#define DRAIN_MS 200                  // Loopback mode: how long to wait for late responses at the end.
+
+static uint64_t replayNowNs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(const char *program){
+    printf("Usage: %s [-l port] [-x speed] [-n loops] trace_file\n", program);
+    exit(1);
+}
+
+// Send every record to the server on localhost, keeping the original spacing divided by speed.
+static int replayLoopback(const TraceRecord **records, long count, int port, double speed){
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in serverAddress;
+    bzero(&serverAddress, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    serverAddress.sin_port = htons(port);
+    if(sockfd < 0 || connect(sockfd, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0){
+        printf("\nERROR - COULD NOT CONNECT TO PORT %d.\n", port);
+        return -1;
+    }
+
+    unsigned char response[2048];
+    long responses = 0;
+    uint64_t start = replayNowNs();
+    for(long i = 0; i < count; i++){
+        if(speed > 0){
+            uint64_t due = start + (uint64_t)((records[i]->timestampNs - records[0]->timestampNs) / speed);
+            uint64_t now = replayNowNs();
+            if(due > now){
+                struct timespec pause = {(time_t)((due - now) / 1000000000ULL), (long)((due - now) % 1000000000ULL)};
+                nanosleep(&pause, NULL);
+            }
+        }
+        send(sockfd, records[i] + 1, records[i]->length, 0);
+        while(recv(sockfd, response, sizeof(response), MSG_DONTWAIT) > 0){
+            responses++;
+        }
+    }
+    double elapsed = (replayNowNs() - start) / 1e9;
+
+    // Responses to the last packets may still be on their way.
+    struct pollfd pfd = {sockfd, POLLIN, 0};
+    while(poll(&pfd, 1, DRAIN_MS) > 0 && recv(sockfd, response, sizeof(response), 0) > 0){
+        responses++;
+    }
+    close(sockfd);
+
+    printf("mode=loopback speed=%g packets=%ld responses=%ld seconds=%.3f packets_per_sec=%.0f\n",
+           speed, count, responses, elapsed, elapsed > 0 ? count / elapsed : 0.0);
+    return 0;
+}
+
+#if defined(REPLAY_ASSIGNMENT_1)
+
+// Feed every record to processPacket(), starting from a fresh server state on each loop.
+static void replayDirect(const TraceRecord **records, long count, int loops){
+    static ServerState state;
+    ServerResponse responses[FEC_MAX_K];
+    int responseLen[FEC_MAX_K];
+    long acks = 0, rejects = 0;
+    struct sockaddr_in from;
+    bzero(&from, sizeof(from));
+    from.sin_family = AF_INET;
+
+    uint64_t start = replayNowNs();
+    for(int loop = 0; loop < loops; loop++){
+        initializeServerState(&state);
+        state.quiet = 1;
+        for(long i = 0; i < count; i++){
+            from.sin_addr.s_addr = records[i]->address;
+            from.sin_port = records[i]->port;
+            int responseCount = processPacket(&state, records[i] + 1, records[i]->length, &from, responses, responseLen);
+            for(int r = 0; r < responseCount; r++){
+                if(responses[r].ack.packet_type == ACK){
+                    acks++;
+                }else{
+                    rejects++;
+                }
+            }
+        }
+    }
+    double elapsed = (replayNowNs() - start) / 1e9;
+    long packets = count * loops;
+    printf("mode=direct server=assignment_1 packets=%ld acks=%ld rejects=%ld seconds=%.3f ns_per_packet=%.1f packets_per_sec=%.0f\n",
+           packets, acks, rejects, elapsed, packets > 0 ? elapsed * 1e9 / packets : 0.0, elapsed > 0 ? packets / elapsed : 0.0);
+}
+
+#elif defined(REPLAY_ASSIGNMENT_2)
+
+// Feed every record to handlePermissionPacket(), with its captured source address.
+static void replayDirect(const TraceRecord **records, long count, int loops){
+    static ServerData serverData[NUM_OF_SUBS];
+    if(access("Verification_Database.txt", R_OK) != 0){
+        printf("\nERROR - Verification_Database.txt NOT FOUND. RUN FROM THE Assignment_2 FOLDER.\n");
+        exit(1);
+    }
+    getServerData(serverData);
+    ServerContext context = {serverData, 1, NULL, NULL, NULL, NULL};
+
+    PermissionPacket receivedPacket;
+    PermissionPacket sendPacket;
+    struct sockaddr_in from;
+    long accessOk = 0, notPaid = 0, notExist = 0, ignored = 0;
+    bzero(&from, sizeof(from));
+    from.sin_family = AF_INET;
+
+    uint64_t start = replayNowNs();
+    for(int loop = 0; loop < loops; loop++){
+        for(long i = 0; i < count; i++){
+            int length = records[i]->length < (int)sizeof(receivedPacket) ? records[i]->length : (int)sizeof(receivedPacket);
+            memset(&receivedPacket, 0, sizeof(receivedPacket));
+            memcpy(&receivedPacket, records[i] + 1, length);
+            from.sin_addr.s_addr = records[i]->address;
+            from.sin_port = records[i]->port;
+            if(!handlePermissionPacket(&context, &receivedPacket, &sendPacket, &from)){
+                ignored++;
+            }else if(sendPacket.permission == ACCESS_OK){
+                accessOk++;
+            }else if(sendPacket.permission == NOT_PAID){
+                notPaid++;
+            }else{
+                notExist++;
+            }
+        }
+    }
+    double elapsed = (replayNowNs() - start) / 1e9;
+    long packets = count * loops;
+    printf("mode=direct server=assignment_2 packets=%ld access_ok=%ld not_paid=%ld not_exist=%ld ignored=%ld seconds=%.3f ns_per_packet=%.1f packets_per_sec=%.0f\n",
+           packets, accessOk, notPaid, notExist, ignored, elapsed, packets > 0 ? elapsed * 1e9 / packets : 0.0,
+           elapsed > 0 ? packets / elapsed : 0.0);
+}
+
+#endif
+
+int main(int argc, char *argv[]){
+    int port = 0;
+    double speed = 1;
+    int loops = 1;
+    int option;
+
+    while((option = getopt(argc, argv, "l:x:n:")) != -1){
+        if(option == 'l'){
+            port = atoi(optarg);
+        }else if(option == 'x'){
+            speed = atof(optarg);
+        }else if(option == 'n'){
+            loops = atoi(optarg);
+        }else{
+            usage(argv[0]);
+        }
+    }
+    if(optind != argc - 1 || loops <= 0 || speed < 0){
+        usage(argv[0]);
+    }
+
+    TraceReader reader;
+    if(traceReaderOpen(&reader, argv[optind]) < 0){
+        printf("\nERROR - %s IS NOT A READABLE TRACE FILE.\n", argv[optind]);
+        return 1;
+    }
+
+    // Index the records once, so the timed loops only touch the packets themselves.
+    long count = 0, capacity = 1024;
+    const TraceRecord **records = malloc(capacity * sizeof(*records));
+    const TraceRecord *record;
+    while(records != NULL && (record = traceReaderNext(&reader)) != NULL){
+        if(count == capacity){
+            capacity *= 2;
+            records = realloc(records, capacity * sizeof(*records));
+            if(records == NULL){
+                break;
+            }
+        }
+        records[count++] = record;
+    }
+    if(records == NULL){
+        printf("\nERROR - OUT OF MEMORY.\n");
+        return 1;
+    }
+    printf("trace=%s packets=%ld span_seconds=%.3f\n", argv[optind], count,
+           count > 1 ? (records[count - 1]->timestampNs - records[0]->timestampNs) / 1e9 : 0.0);
+
+    int result = 0;
+    if(port > 0){
+        result = replayLoopback(records, count, port, speed) < 0;
+    }else{
+#if defined(REPLAY_ASSIGNMENT_1) || defined(REPLAY_ASSIGNMENT_2)
+        replayDirect(records, count, loops);
+#else
+        printf("\nERROR - BUILT WITHOUT A SERVER, ONLY LOOPBACK REPLAY (-l PORT) IS AVAILABLE.\n");
+        result = 1;
+#endif
+    }
+    free(records);
+    traceReaderClose(&reader);
+    return result;
+}
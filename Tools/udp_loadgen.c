@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../Common/udp_offload.h"
+
+// -----------------------------------------------------------------------------
+// UDP Load Generator
+// -----------------------------------------------------------------------------
+//
+// Keeps a window of requests outstanding against one of the servers on localhost
+// and reports how many responses per second come back. Requests and responses are
+// batched with sendmmsg()/recvmmsg() so the generator is not the bottleneck.
+// With -g the requests leave as UDP GSO super-buffers instead (one sendmsg per
+// batch, split by the kernel), falling back to sendmmsg() if GSO is unavailable.
+// Used by bench_backends.sh and bench_gso.sh.
+//
+// Compile: gcc -O2 udp_loadgen.c -o udp_loadgen
+// Run:     ./udp_loadgen -m a2 -p 8081 -d 5 -w 256 [-g]
+
+#define BATCH 64                      // Datagrams per sendmmsg()/recvmmsg() call.
+#define STALL_MS 20                   // Forget outstanding requests after this long without a response.
+
+// Same layout as the DataPacket in Assignment_1.
+typedef struct DataPacket{
+    uint16_t start_packet_identifier;
+    uint8_t client_id;
+    uint16_t packet_type;
+    uint8_t seg_no;
+    uint8_t plen;
+    char pload[255];
+    uint16_t end_packet_identifier;
+} DataPacket;
+
+// Same layout as the PermissionPacket in Assignment_2.
+typedef struct PermissionPacket{
+    uint16_t start_packet_identifier;
+    uint8_t client_id;
+    uint16_t permission;
+    uint8_t seg_no;
+    uint8_t plen;
+    uint8_t technology;
+    unsigned long src_sub_no;
+    uint16_t end_packet_identifier;
+    uint32_t cookie;
+} PermissionPacket;
+
+static uint64_t nowNs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Build the request template for the selected server. Returns its size.
+static int buildRequest(const char *mode, unsigned char *request){
+    if(strcmp(mode, "a1") == 0){
+        DataPacket dataPacket;
+        memset(&dataPacket, 0, sizeof(dataPacket));
+        dataPacket.start_packet_identifier = 0XFFFF;
+        dataPacket.client_id = 0XFF;
+        dataPacket.packet_type = 0XFF1;
+        dataPacket.seg_no = 1;
+        strcpy(dataPacket.pload, "Payload Packet #1\n");
+        dataPacket.plen = strlen(dataPacket.pload);
+        dataPacket.end_packet_identifier = 0XFFFF;
+        memcpy(request, &dataPacket, sizeof(dataPacket));
+        return sizeof(dataPacket);
+    }
+    if(strcmp(mode, "a2") == 0){
+        PermissionPacket permissionPacket;
+        memset(&permissionPacket, 0, sizeof(permissionPacket));
+        permissionPacket.start_packet_identifier = 0XFFFF;
+        permissionPacket.client_id = 0XFF;
+        permissionPacket.permission = 0XFFF8;
+        permissionPacket.seg_no = 1;
+        permissionPacket.plen = 11;
+        permissionPacket.technology = 3;
+        permissionPacket.src_sub_no = 7867098787UL;
+        permissionPacket.end_packet_identifier = 0XFFFF;
+        memcpy(request, &permissionPacket, sizeof(permissionPacket));
+        return sizeof(permissionPacket);
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[]){
+    const char *mode = "a2";
+    int port = 8081;
+    double duration = 5;
+    int window = 256;
+    int useGso = 0;
+    int option;
+
+    while((option = getopt(argc, argv, "m:p:d:w:g")) != -1){
+        if(option == 'm'){
+            mode = optarg;
+        }else if(option == 'p'){
+            port = atoi(optarg);
+        }else if(option == 'd'){
+            duration = atof(optarg);
+        }else if(option == 'w'){
+            window = atoi(optarg);
+        }else if(option == 'g'){
+            useGso = 1;
+        }else{
+            printf("Usage: %s [-m a1|a2] [-p port] [-d seconds] [-w window] [-g]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    unsigned char request[512];
+    int requestLen = buildRequest(mode, request);
+    if(requestLen < 0 || window <= 0){
+        printf("Usage: %s [-m a1|a2] [-p port] [-d seconds] [-w window] [-g]\n", argv[0]);
+        return 1;
+    }
+
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in serverAddress;
+    bzero(&serverAddress, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    serverAddress.sin_port = htons(port);
+    if(sockfd < 0 || connect(sockfd, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0){
+        printf("\nERROR - COULD NOT CONNECT TO PORT %d.\n", port);
+        return 1;
+    }
+    int bufferSize = 4 << 20;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+
+    // Every outgoing message points at the same request; responses get their own buffers.
+    struct mmsghdr sendMsgs[BATCH], recvMsgs[BATCH];
+    struct iovec sendIov[BATCH], recvIov[BATCH];
+    static unsigned char responses[BATCH][2048];
+    static unsigned char superBuffer[BATCH * 512];
+    memset(sendMsgs, 0, sizeof(sendMsgs));
+    memset(recvMsgs, 0, sizeof(recvMsgs));
+    for(int i = 0; i < BATCH; i++){
+        sendIov[i].iov_base = request;
+        sendIov[i].iov_len = requestLen;
+        sendMsgs[i].msg_hdr.msg_iov = &sendIov[i];
+        sendMsgs[i].msg_hdr.msg_iovlen = 1;
+        recvIov[i].iov_base = responses[i];
+        recvIov[i].iov_len = sizeof(responses[i]);
+        recvMsgs[i].msg_hdr.msg_iov = &recvIov[i];
+        recvMsgs[i].msg_hdr.msg_iovlen = 1;
+        memcpy(superBuffer + (size_t)i * requestLen, request, requestLen);
+    }
+
+    long sent = 0, received = 0, stalls = 0;
+    long outstanding = 0;
+    uint64_t start = nowNs();
+    uint64_t end = start + (uint64_t)(duration * 1e9);
+    uint64_t lastProgress = start;
+    uint64_t now = start;
+
+    while(now < end){
+        // Top the window up.
+        while(outstanding < window){
+            int count = window - outstanding < BATCH ? (int)(window - outstanding) : BATCH;
+            int done;
+            if(useGso){
+                // The socket is connected, so no destination address is needed.
+                done = udpGsoSend(sockfd, superBuffer, requestLen, count, NULL, 0);
+                if(done < 0 && errno != EAGAIN){
+                    printf("INFO - UDP GSO IS NOT AVAILABLE, USING SENDMMSG.\n");
+                    useGso = 0;
+                    continue;
+                }
+                done = done < 0 ? 0 : done / requestLen;
+            }else{
+                done = sendmmsg(sockfd, sendMsgs, count, MSG_DONTWAIT);
+            }
+            if(done <= 0){
+                break;
+            }
+            sent += done;
+            outstanding += done;
+        }
+
+        // Collect whatever responses are ready, waiting briefly if there are none.
+        struct pollfd pfd = {sockfd, POLLIN, 0};
+        if(poll(&pfd, 1, 1) > 0){
+            int done;
+            while((done = recvmmsg(sockfd, recvMsgs, BATCH, MSG_DONTWAIT, NULL)) > 0){
+                received += done;
+                outstanding -= done;
+                if(outstanding < 0){
+                    outstanding = 0;
+                }
+            }
+            lastProgress = nowNs();
+        }
+
+        // Responses that never came back (dropped by a full socket buffer) must not shrink the window forever.
+        now = nowNs();
+        if(outstanding > 0 && now - lastProgress > STALL_MS * 1000000ULL){
+            outstanding = 0;
+            lastProgress = now;
+            stalls++;
+        }
+    }
+
+    double elapsed = (nowNs() - start) / 1e9;
+    printf("mode=%s gso=%d window=%d seconds=%.2f sent=%ld received=%ld lost=%ld stalls=%ld responses_per_sec=%.0f\n",
+           mode, useGso, window, elapsed, sent, received, sent - received, stalls, received / elapsed);
+    return 0;
+}